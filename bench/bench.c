@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+
+#include "bench.h"
+
+#define WARMUP_TIME_NS 50e6
+#define SAMPLE_TIME_NS 10e6
+#define NUM_SAMPLES 15
+
+static const char *filter = NULL;
+static int failed = 0;
+
+static double now_ns(void) {
+    return SDL_GetPerformanceCounter() * (1e9 / SDL_GetPerformanceFrequency());
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *name, bench_fn fn, void *arg, long ops, long items, const char *unit) {
+    if (filter && !strstr(name, filter)) return;
+
+    // Warm up caches and branch predictors, and estimate the cost of a call
+    long calls = 0;
+    double start = now_ns();
+    double elapsed = 0;
+    while (elapsed < WARMUP_TIME_NS) {
+        fn(arg);
+        calls += 1;
+        elapsed = now_ns() - start;
+    }
+    long batch = (long)(SAMPLE_TIME_NS / (elapsed / calls));
+    if (batch < 1) batch = 1;
+
+    // Time batches of calls and keep the time per operation of each
+    double samples[NUM_SAMPLES];
+    for (int i = 0; i < NUM_SAMPLES; i += 1) {
+        start = now_ns();
+        for (long j = 0; j < batch; j += 1) {
+            fn(arg);
+        }
+        samples[i] = (now_ns() - start) / ((double)batch * ops);
+    }
+
+    qsort(samples, NUM_SAMPLES, sizeof(double), compare_doubles);
+    double median = samples[NUM_SAMPLES / 2];
+
+    double mean = 0;
+    for (int i = 0; i < NUM_SAMPLES; i += 1) mean += samples[i];
+    mean /= NUM_SAMPLES;
+    double variance = 0;
+    for (int i = 0; i < NUM_SAMPLES; i += 1) variance += (samples[i] - mean) * (samples[i] - mean);
+    double stddev = sqrt(variance / (NUM_SAMPLES - 1));
+
+    // Items per op over ns per op is in billions per second; report millions
+    char rate[32];
+    snprintf(rate, sizeof(rate), "M%s/s", unit);
+    printf("%-40s %12.1f ns/op  %6.1f%%  %10.1f %-9s (min %.1f, max %.1f)\n",
+        name, median, 100 * stddev / mean, (double)items / ops / median * 1e3, rate,
+        samples[0], samples[NUM_SAMPLES - 1]);
+}
+
+void bench_run(const char *name, bench_fn fn, void *arg, long ops, long bytes) {
+    if (bytes > 0) {
+        run(name, fn, arg, ops, bytes, "B");
+    } else {
+        run(name, fn, arg, ops, ops, "op");
+    }
+}
+
+void bench_run_items(const char *name, bench_fn fn, void *arg, long ops, long items, const char *unit) {
+    run(name, fn, arg, ops, items, unit);
+}
+
+void bench_check(int ok, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        failed = 1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Optionally only run the benchmarks whose name contains argv[1]
+    if (argc > 1) filter = argv[1];
+
+    printf("%-40s %18s  %7s  %15s\n", "benchmark", "median", "stddev", "throughput");
+
+    bench_math();
+    bench_clip();
+    bench_raster();
+    bench_light();
+    bench_mesh();
+    bench_png();
+
+    return failed;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Microbenchmark harness
+//
+// A benchmark is a function called repeatedly with the same argument. Each
+// call performs `ops` operations over `bytes` bytes of data (0 when a byte
+// rate doesn't make sense, in which case operations per second are shown).
+// The harness warms up, picks a batch size so every sample is long enough to
+// time reliably, then reports the median time per operation over a number
+// of samples.
+
+typedef void (*bench_fn)(void *arg);
+
+void bench_run(const char *name, bench_fn fn, void *arg, long ops, long bytes);
+
+// Same, reporting the throughput in `items` of `unit` per call instead
+// (e.g. pixels for the rasterizer)
+void bench_run_items(const char *name, bench_fn fn, void *arg, long ops, long items, const char *unit);
+
+// Record the outcome of a correctness check done alongside the benchmarks;
+// the harness exits with an error if any failed
+void bench_check(int ok, const char *what);
+
+// Benchmark suites
+void bench_math(void);
+void bench_clip(void);
+void bench_raster(void);
+void bench_light(void);
+void bench_mesh(void);
+void bench_png(void);
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <math.h>
+#include <SDL2/SDL.h> // for M_PI
+
+#include "bench.h"
+#include "clipping.h"
+
+// Polygons clipped per call, since one takes well under a microsecond
+#define NUM_POLYGONS 256
+
+typedef struct {
+    polygon_t polygon;
+    int expected_vertices;  // after clipping
+} clip_case_t;
+
+static polygon_t polygons[NUM_POLYGONS];
+
+static void run_clip_polygon(void *arg) {
+    const clip_case_t *clip_case = arg;
+    for (int i = 0; i < NUM_POLYGONS; i += 1) {
+        polygons[i] = clip_case->polygon;
+        clip_polygon(&polygons[i]);
+    }
+}
+
+static void bench_clip_case(const char *name, vec3_t v0, vec3_t v1, vec3_t v2, int expected_vertices) {
+    tex2_t t0 = { 0, 0 }, t1 = { 1, 0 }, t2 = { 0, 1 };
+    clip_case_t clip_case = {
+        .polygon = create_polygon_from_triangle(v0, v1, v2, t0, t1, t2),
+        .expected_vertices = expected_vertices,
+    };
+
+    // Check each case really exercises the path it's named after
+    polygon_t polygon = clip_case.polygon;
+    clip_polygon(&polygon);
+    char what[96];
+    snprintf(what, sizeof(what), "%s clips to %d vertices", name, expected_vertices);
+    bench_check(polygon.num_vertices == expected_vertices, what);
+
+    bench_run(name, run_clip_polygon, &clip_case, NUM_POLYGONS, 0);
+}
+
+// The renderer's frustum, with triangles entirely inside it, cutting through
+// the left and near planes, and entirely outside it
+void bench_clip(void) {
+    float fovy = M_PI / 3;
+    float fovx = atan(tan(fovy / 2) * 4 / 3.0) * 2;
+    init_frustum_planes(fovy, fovx, 1, 20);
+
+    bench_clip_case("clip_polygon inside",
+        (vec3_t) { -1, -1, 5 }, (vec3_t) { 0, 1, 5 }, (vec3_t) { 1, -1, 5 }, 3);
+    bench_clip_case("clip_polygon straddling",
+        (vec3_t) { -8, 0, 10 }, (vec3_t) { 0, 0, 0.5 }, (vec3_t) { 1, -1, 10 }, 5);
+    bench_clip_case("clip_polygon outside",
+        (vec3_t) { -9, -1, 5 }, (vec3_t) { -8, 1, 5 }, (vec3_t) { -7, -1, 5 }, 0);
+
+    // Wireframe edges are clipped as segments against the same planes
+    vec3_t a = { 0, 0, 0.5 }, b = { 0, 0, 5 };
+    bench_check(clip_segment(&a, &b) && fabs(a.z - 1) < 1e-5 && b.z == 5, "clip_segment cuts at the near plane");
+    a = (vec3_t) { -9, 0, 5 }, b = (vec3_t) { -8, 0, 5 };
+    bench_check(!clip_segment(&a, &b), "clip_segment rejects a segment outside the frustum");
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "light.h"
+
+// A row of pixels, as a span of a smooth shaded triangle would light
+#define NUM_PIXELS 1024
+
+static uint32_t colors[NUM_PIXELS];
+static uint32_t out[NUM_PIXELS];
+static uint16_t intensities[NUM_PIXELS];
+static float float_intensities[NUM_PIXELS];
+
+// How colors were lit before fixed point: a float multiply per channel
+static uint32_t float_modulate(uint32_t color, float factor) {
+    uint32_t a = (color & 0xFF000000);
+    uint32_t r = (color & 0x00FF0000) * factor;
+    uint32_t g = (color & 0x0000FF00) * factor;
+    uint32_t b = (color & 0x000000FF) * factor;
+    return a | (r & 0x00FF0000) | (g & 0x0000FF00) | (b & 0x000000FF);
+}
+
+static void run_float_modulate(void *arg) {
+    for (int i = 0; i < NUM_PIXELS; i += 1) out[i] = float_modulate(colors[i], float_intensities[i]);
+}
+
+static void run_light_modulate(void *arg) {
+    for (int i = 0; i < NUM_PIXELS; i += 1) out[i] = light_modulate(colors[i], intensities[i]);
+}
+
+static void run_light_modulate_colors(void *arg) {
+    memcpy(out, colors, sizeof(colors));
+    light_modulate_colors(out, intensities, NUM_PIXELS);
+}
+
+// The vector path should light every channel value at every intensity
+// exactly as the scalar one does, including the tail past a multiple of 4
+static void check_light_modulate(void) {
+    int count = 256 * (LIGHT_ONE + 1) + 3;
+    uint32_t *lit = malloc(count * sizeof(uint32_t));
+    uint16_t *k = malloc(count * sizeof(uint16_t));
+    if (!lit || !k) {
+        fprintf(stderr, "Can't allocate the light check, skipping it.\n");
+        free(lit);
+        free(k);
+        return;
+    }
+
+    for (int i = 0; i < count; i += 1) {
+        int value = i % 256;
+        k[i] = (i / 256) % (LIGHT_ONE + 1);
+        lit[i] = (uint32_t)(255 - value) << 24 | value << 16 | (value ^ 0x5A) << 8 | (255 - value);
+    }
+    light_modulate_colors(lit, k, count);
+
+    int num_wrong = 0;
+    for (int i = 0; i < count; i += 1) {
+        int value = i % 256;
+        uint32_t color = (uint32_t)(255 - value) << 24 | value << 16 | (value ^ 0x5A) << 8 | (255 - value);
+        if (lit[i] != light_modulate(color, k[i])) num_wrong += 1;
+    }
+    free(lit);
+    free(k);
+
+    bench_check(num_wrong == 0, "light_modulate_colors matches light_modulate");
+    bench_check(light_modulate(0x80FF7F01, LIGHT_ONE) == 0x80FF7F01, "full intensity leaves colors unchanged");
+    bench_check(light_modulate(0x80FF7F01, 0) == 0x80000000, "zero intensity keeps only alpha");
+}
+
+// Lighting a row of pixels each with its own intensity, as smooth shading
+// will, per pixel in float and fixed point and with the vector kernels
+void bench_light(void) {
+    check_light_modulate();
+
+    srand(1);
+    for (int i = 0; i < NUM_PIXELS; i += 1) {
+        colors[i] = 0xFF000000 | (rand() & 0xFFFFFF);
+        float_intensities[i] = rand() / (float)RAND_MAX;
+        intensities[i] = light_intensity_fixed(float_intensities[i]);
+    }
+
+    bench_run_items("light float per channel", run_float_modulate, NULL, NUM_PIXELS, NUM_PIXELS, "px");
+    bench_run_items("light_modulate", run_light_modulate, NULL, NUM_PIXELS, NUM_PIXELS, "px");
+    bench_run_items("light_modulate_colors", run_light_modulate_colors, NULL, NUM_PIXELS, NUM_PIXELS, "px");
+}
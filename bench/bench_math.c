@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <SDL2/SDL.h> // for M_PI
+
+#include "bench.h"
+#include "vector.h"
+#include "matrix.h"
+
+// Enough vectors that each call does meaningful work, few enough to stay in
+// L1 (1024 vec4s are 16KB)
+#define NUM_VECTORS 1024
+
+static vec3_t a[NUM_VECTORS];
+static vec3_t b[NUM_VECTORS];
+static vec3_t out3[NUM_VECTORS];
+static vec4_t in4[NUM_VECTORS];
+static vec4_t out4[NUM_VECTORS];
+static float out1[NUM_VECTORS];
+static mat4_t matrices[NUM_VECTORS];
+static mat4_t out_matrices[NUM_VECTORS];
+static mat4_t transform;
+
+static float random_float(void) {
+    return rand() / (float)RAND_MAX * 2 - 1;
+}
+
+static void run_vec3_add(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out3[i] = vec3_add(a[i], b[i]);
+}
+
+static void run_vec3_cross(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out3[i] = vec3_cross(a[i], b[i]);
+}
+
+static void run_vec3_dot(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out1[i] = vec3_dot(a[i], b[i]);
+}
+
+static void run_vec3_normalize(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) {
+        out3[i] = a[i];
+        vec3_normalize(&out3[i]);
+    }
+}
+
+static void run_mat4_mul_vec4(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out4[i] = mat4_mul_vec4(transform, in4[i]);
+}
+
+static void run_mat4_mul_vec4_project(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out4[i] = mat4_mul_vec4_project(transform, in4[i]);
+}
+
+static void run_mat4_mul_mat4(void *arg) {
+    for (int i = 0; i < NUM_VECTORS; i += 1) out_matrices[i] = mat4_mul_mat4(transform, matrices[i]);
+}
+
+static void run_mat4_look_at(void *arg) {
+    vec3_t up = { 0, 1, 0 };
+    for (int i = 0; i < NUM_VECTORS; i += 1) out_matrices[i] = mat4_look_at(a[i], b[i], up);
+}
+
+void bench_math(void) {
+    srand(1);
+    for (int i = 0; i < NUM_VECTORS; i += 1) {
+        a[i] = vec3_new(random_float(), random_float(), random_float());
+        b[i] = vec3_new(random_float(), random_float(), random_float() + 4);
+        in4[i] = vec4_from_vec3(b[i]);
+        matrices[i] = mat4_mul_mat4(mat4_make_rotation_y(random_float()), mat4_make_translation(a[i].x, a[i].y, a[i].z));
+    }
+    transform = mat4_make_perspective(M_PI / 3, 0.75, 1, 20);
+
+    bench_run("vec3_add", run_vec3_add, NULL, NUM_VECTORS, 0);
+    bench_run("vec3_cross", run_vec3_cross, NULL, NUM_VECTORS, 0);
+    bench_run("vec3_dot", run_vec3_dot, NULL, NUM_VECTORS, 0);
+    bench_run("vec3_normalize", run_vec3_normalize, NULL, NUM_VECTORS, 0);
+    bench_run("mat4_mul_vec4", run_mat4_mul_vec4, NULL, NUM_VECTORS, 0);
+    bench_run("mat4_mul_vec4_project", run_mat4_mul_vec4_project, NULL, NUM_VECTORS, 0);
+    bench_run("mat4_mul_mat4", run_mat4_mul_mat4, NULL, NUM_VECTORS, 0);
+    bench_run("mat4_look_at", run_mat4_look_at, NULL, NUM_VECTORS, 0);
+}
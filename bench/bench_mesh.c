@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <SDL2/SDL.h> // for M_PI
+
+#include "bench.h"
+#include "mesh.h"
+#include "array.h"
+#include "quantize.h"
+
+static void parse_obj(void *arg) {
+    mesh_t mesh;
+    memset(&mesh, 0, sizeof(mesh));
+    load_mesh_obj_data(&mesh, arg);
+    array_free(mesh.normals);
+    array_free(mesh.faces);
+    array_free(mesh.vertices);
+}
+
+static void build_edges(void *arg) {
+    build_mesh_edges(arg);
+}
+
+// Build the unique edge list of a mesh, reporting the throughput in faces
+static void bench_mesh_edges(const char *filename, bool closed) {
+    mesh_t mesh;
+    memset(&mesh, 0, sizeof(mesh));
+    load_mesh_obj_data(&mesh, (char *)filename);
+    build_mesh_edges(&mesh);
+
+    // Every edge of a closed mesh is shared by two faces
+    int num_faces = array_length(mesh.faces);
+    int num_edges = array_length(mesh.edges);
+    if (closed) {
+        bool paired = num_edges * 2 == num_faces * 3;
+        for (int i = 0; i < num_edges; i += 1) {
+            if (mesh.edges[i].face_b < 0) paired = false;
+        }
+        char what[96];
+        snprintf(what, sizeof(what), "build_mesh_edges pairs the faces of %s", filename + 9);
+        bench_check(paired, what);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "build_mesh_edges %s", filename + 9);
+    bench_run_items(name, build_edges, &mesh, 1, num_faces, "faces");
+
+    array_free(mesh.edges);
+    array_free(mesh.normals);
+    array_free(mesh.faces);
+    array_free(mesh.vertices);
+}
+
+static void round_trip_normals(void *arg) {
+    mesh_t *mesh = arg;
+    int num_normals = array_length(mesh->normals);
+    for (int i = 0; i < num_normals; i += 1) {
+        mesh->normals[i] = qnormal_decode(qnormal_encode(mesh->normals[i]));
+    }
+}
+
+// Check every face corner of a mesh gets a unit normal, from the file or
+// generated, and how far octahedral encoding turns them, reporting its
+// throughput in normals
+static void bench_mesh_normals(const char *filename) {
+    mesh_t mesh;
+    memset(&mesh, 0, sizeof(mesh));
+    load_mesh_obj_data(&mesh, (char *)filename);
+
+    int num_faces = array_length(mesh.faces);
+    int num_normals = array_length(mesh.normals);
+    bool valid = num_normals > 0;
+    for (int i = 0; i < num_faces; i += 1) {
+        int corners[3] = { mesh.faces[i].a_normal, mesh.faces[i].b_normal, mesh.faces[i].c_normal };
+        for (int j = 0; j < 3; j += 1) {
+            if (corners[j] < 0 || corners[j] >= num_normals) valid = false;
+        }
+    }
+    float max_error = 0;
+    for (int i = 0; i < num_normals; i += 1) {
+        vec3_t normal = mesh.normals[i];
+        if (fabsf(vec3_length(normal) - 1) > 1e-4f) valid = false;
+        vec3_t decoded = qnormal_decode(qnormal_encode(normal));
+        // (atan2 rather than acos, which loses small angles to rounding)
+        float angle = atan2f(vec3_length(vec3_cross(normal, decoded)), vec3_dot(normal, decoded));
+        max_error = fmaxf(max_error, angle * 180 / M_PI);
+    }
+
+    char what[96];
+    snprintf(what, sizeof(what), "every face corner of %s has a unit normal", filename + 9);
+    bench_check(valid, what);
+    snprintf(what, sizeof(what), "qnormal keeps %s within 0.01 degrees", filename + 9);
+    bench_check(max_error < 0.01f, what);
+
+    char name[64];
+    snprintf(name, sizeof(name), "qnormal round trip %s", filename + 9);
+    printf("%-40s %11.4f degrees max\n", name, max_error);
+    bench_run_items(name, round_trip_normals, &mesh, 1, num_normals, "normals");
+
+    array_free(mesh.normals);
+    array_free(mesh.faces);
+    array_free(mesh.vertices);
+}
+
+// Parse every OBJ asset from disk (so from the page cache after warmup),
+// reporting the throughput in bytes of OBJ text
+void bench_mesh(void) {
+    char *filenames[] = {
+        "./assets/cow.obj",
+        "./assets/crab.obj",
+        "./assets/cube.obj",
+        "./assets/drone.obj",
+        "./assets/efa.obj",
+        "./assets/f117.obj",
+        "./assets/f22.obj",
+        "./assets/nefertiti.obj",
+        "./assets/sphere.obj",
+        "./assets/stanford-bunny.obj",
+        "./assets/suzanne.obj",
+        "./assets/teapot.obj",
+    };
+    int num_files = sizeof(filenames) / sizeof(filenames[0]);
+
+    for (int i = 0; i < num_files; i += 1) {
+        // load_mesh_obj_data exits on a missing file
+        FILE *file = fopen(filenames[i], "rb");
+        if (!file) {
+            fprintf(stderr, "Can't open %s, skipping.\n", filenames[i]);
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+
+        char name[64];
+        snprintf(name, sizeof(name), "load_mesh_obj_data %s", filenames[i] + 9);
+        bench_run(name, parse_obj, filenames[i], 1, size);
+    }
+
+    bench_mesh_edges("./assets/cube.obj", true);
+    bench_mesh_edges("./assets/f22.obj", false);
+
+    // Normals from the file, then generated ones
+    bench_mesh_normals("./assets/suzanne.obj");
+    bench_mesh_normals("./assets/teapot.obj");
+}
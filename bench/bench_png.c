@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "upng.h"
+#include "texture.h"
+
+typedef struct {
+    unsigned char *data;
+    long size;
+} png_file_t;
+
+static void decode_png_with(png_file_t *file, int simd) {
+    upng_t *png = upng_new_from_bytes(file->data, file->size);
+    upng_set_simd(png, simd);
+    upng_decode(png);
+    upng_free(png);
+}
+
+static void decode_png(void *arg) {
+    decode_png_with(arg, 1);
+}
+
+static void decode_png_scalar(void *arg) {
+    decode_png_with(arg, 0);
+}
+
+static uint32_t crc32(const unsigned char *data, unsigned long size, uint32_t crc) {
+    crc = ~crc;
+    for (unsigned long i = 0; i < size; i += 1) {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k += 1) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+// Write a chunk (length, type, data and CRC) at p, returning the end of it
+static unsigned char *put_chunk(unsigned char *p, const char *type, const unsigned char *data, int size) {
+    put_u32(p, size);
+    memcpy(p + 4, type, 4);
+    if (size > 0) memcpy(p + 8, data, size);
+    put_u32(p + 8 + size, crc32(p + 4, 4 + size, 0));
+    return p + 12 + size;
+}
+
+// Wrap filtered scanlines (filter type byte included) into a PNG, using a
+// single uncompressed deflate block so any filter sequence can be produced.
+// A palette (and its alpha) is added when plte_size is non-zero.
+static png_file_t make_png_ex(
+    int width, int height, int bit_depth, int color_type,
+    const unsigned char *plte, int plte_size, const unsigned char *trns, int trns_size,
+    const unsigned char *scanlines, int size
+) {
+    png_file_t png_file;
+    png_file.size = 8 + (12 + 13) + (12 + 2 + 5 + size + 4) + 12;
+    if (plte_size > 0) png_file.size += 12 + plte_size;
+    if (trns_size > 0) png_file.size += 12 + trns_size;
+    png_file.data = malloc(png_file.size);
+
+    unsigned char *p = png_file.data;
+    memcpy(p, "\x89PNG\r\n\x1a\n", 8);
+    p += 8;
+
+    unsigned char ihdr[13];
+    put_u32(ihdr, width);
+    put_u32(ihdr + 4, height);
+    ihdr[8] = bit_depth;
+    ihdr[9] = color_type;
+    ihdr[10] = 0;       // compression
+    ihdr[11] = 0;       // filter method
+    ihdr[12] = 0;       // no interlacing
+    p = put_chunk(p, "IHDR", ihdr, 13);
+
+    if (plte_size > 0) p = put_chunk(p, "PLTE", plte, plte_size);
+    if (trns_size > 0) p = put_chunk(p, "tRNS", trns, trns_size);
+
+    unsigned char *zlib = malloc(2 + 5 + size + 4);
+    zlib[0] = 0x78;     // deflate, 32K window
+    zlib[1] = 0x01;     // no preset dictionary, FCHECK
+    zlib[2] = 0x01;     // final block, uncompressed
+    zlib[3] = size & 0xFF;
+    zlib[4] = size >> 8;
+    zlib[5] = ~size & 0xFF;
+    zlib[6] = (~size >> 8) & 0xFF;
+    memcpy(zlib + 7, scanlines, size);
+    uint32_t a = 1, b = 0;
+    for (int i = 0; i < size; i += 1) {
+        a = (a + scanlines[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32(zlib + 7 + size, (b << 16) | a);
+    p = put_chunk(p, "IDAT", zlib, 2 + 5 + size + 4);
+    free(zlib);
+
+    put_chunk(p, "IEND", NULL, 0);
+
+    return png_file;
+}
+
+static png_file_t make_png(int width, int height, int color_type, const unsigned char *scanlines, int size) {
+    return make_png_ex(width, height, 8, color_type, NULL, 0, NULL, 0, scanlines, size);
+}
+
+// Decode with the SIMD and the scalar unfiltering, which must agree exactly
+static void check_unfilter(png_file_t *png_file, const char *name) {
+    upng_t *simd = upng_new_from_bytes(png_file->data, png_file->size);
+    upng_decode(simd);
+    upng_t *scalar = upng_new_from_bytes(png_file->data, png_file->size);
+    upng_set_simd(scalar, 0);
+    upng_decode(scalar);
+
+    int ok = upng_get_error(simd) == UPNG_EOK &&
+        upng_get_error(scalar) == UPNG_EOK &&
+        upng_get_size(simd) == upng_get_size(scalar) &&
+        memcmp(upng_get_buffer(simd), upng_get_buffer(scalar), upng_get_size(simd)) == 0;
+    char what[96];
+    snprintf(what, sizeof(what), "SIMD and scalar unfiltering of %s match", name);
+    bench_check(ok, what);
+
+    upng_free(simd);
+    upng_free(scalar);
+}
+
+// Random pixels with every filter type in every position, for 3 and 4 byte
+// pixels (RGB8 and RGBA8), including an odd width so SIMD tails are covered
+static void check_unfilter_synthetic(void) {
+    int width = 37;
+    int height = 64;
+    int color_types[] = { 2, 6 };
+    int bytewidths[] = { 3, 4 };
+
+    srand(1);
+    for (int t = 0; t < 2; t += 1) {
+        int stride = 1 + width * bytewidths[t];
+        int size = stride * height;
+        unsigned char *scanlines = malloc(size);
+        for (int y = 0; y < height; y += 1) {
+            scanlines[y * stride] = y % 5;
+            for (int x = 1; x < stride; x += 1) {
+                scanlines[y * stride + x] = rand() & 0xFF;
+            }
+        }
+
+        png_file_t png_file = make_png(width, height, color_types[t], scanlines, size);
+        check_unfilter(&png_file, t == 0 ? "synthetic RGB8" : "synthetic RGBA8");
+        free(png_file.data);
+        free(scanlines);
+    }
+}
+
+// Decode a PNG made by make_png_ex and check the texture it converts to
+static void check_texture(png_file_t png_file, const uint32_t *expected, int num_texels, const char *name) {
+    upng_t *png = upng_new_from_bytes(png_file.data, png_file.size);
+    upng_decode(png);
+    texture_t *texture = upng_get_error(png) == UPNG_EOK ? texture_from_png(png) : NULL;
+
+    int ok = texture != NULL &&
+        texture->width * texture->height == num_texels &&
+        memcmp(texture->texels, expected, num_texels * sizeof(uint32_t)) == 0;
+    char what[96];
+    snprintf(what, sizeof(what), "%s converts to ARGB texels", name);
+    bench_check(ok, what);
+
+    free_texture(texture);
+    upng_free(png);
+    free(png_file.data);
+}
+
+// Formats the assets don't use, each a single 3 pixel scanline
+static void check_texture_formats(void) {
+    unsigned char rgb8[] = { 0, 0xFF, 0x00, 0x00, 0x00, 0x80, 0x00, 0x01, 0x02, 0x03 };
+    uint32_t rgb8_texels[] = { 0xFFFF0000, 0xFF008000, 0xFF010203 };
+    check_texture(make_png_ex(3, 1, 8, 2, NULL, 0, NULL, 0, rgb8, sizeof(rgb8)), rgb8_texels, 3, "RGB8");
+
+    unsigned char gray8[] = { 0, 0x00, 0x80, 0xFF };
+    uint32_t gray8_texels[] = { 0xFF000000, 0xFF808080, 0xFFFFFFFF };
+    check_texture(make_png_ex(3, 1, 8, 0, NULL, 0, NULL, 0, gray8, sizeof(gray8)), gray8_texels, 3, "gray8");
+
+    // 2-bit samples 0, 1 and 3, MSB first
+    unsigned char gray2[] = { 0, 0x1C };
+    uint32_t gray2_texels[] = { 0xFF000000, 0xFF555555, 0xFFFFFFFF };
+    check_texture(make_png_ex(3, 1, 2, 0, NULL, 0, NULL, 0, gray2, sizeof(gray2)), gray2_texels, 3, "gray2");
+
+    unsigned char gray_alpha8[] = { 0, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+    uint32_t gray_alpha8_texels[] = { 0x20101010, 0x40303030, 0x60505050 };
+    check_texture(make_png_ex(3, 1, 8, 4, NULL, 0, NULL, 0, gray_alpha8, sizeof(gray_alpha8)), gray_alpha8_texels, 3, "gray+alpha8");
+
+    // 4-bit indices 2, 0 and 1, with the first entry made translucent
+    unsigned char plte[] = { 0xFF, 0x00, 0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0xFF };
+    unsigned char trns[] = { 0x80 };
+    unsigned char palette4[] = { 0, 0x20, 0x10 };
+    uint32_t palette4_texels[] = { 0xFF0000FF, 0x80FF0000, 0xFF00FF00 };
+    check_texture(make_png_ex(3, 1, 4, 3, plte, sizeof(plte), trns, sizeof(trns), palette4, sizeof(palette4)), palette4_texels, 3, "palette4");
+}
+
+static void convert_png(void *arg) {
+    free_texture(texture_from_png(arg));
+}
+
+// Decode every PNG asset from memory, so file I/O isn't part of the timing
+void bench_png(void) {
+    check_unfilter_synthetic();
+    check_texture_formats();
+
+    char *filenames[] = {
+        "./assets/crab.png",
+        "./assets/cube.png",
+        "./assets/cube-tnt.png",
+        "./assets/drone.png",
+        "./assets/efa.png",
+        "./assets/f117.png",
+        "./assets/f22.png",
+        "./assets/pikuma.png",
+    };
+    int num_files = sizeof(filenames) / sizeof(filenames[0]);
+
+    for (int i = 0; i < num_files; i += 1) {
+        FILE *file = fopen(filenames[i], "rb");
+        if (!file) {
+            fprintf(stderr, "Can't open %s, skipping.\n", filenames[i]);
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        png_file_t png_file = { .size = ftell(file) };
+        rewind(file);
+        png_file.data = malloc(png_file.size);
+        fread(png_file.data, 1, png_file.size, file);
+        fclose(file);
+
+        // Check it decodes at all, and get the size of the output for throughput
+        upng_t *png = upng_new_from_bytes(png_file.data, png_file.size);
+        if (upng_decode(png) == UPNG_EOK) {
+            char name[64];
+            snprintf(name, sizeof(name), "upng_decode %s", filenames[i] + 9);
+            check_unfilter(&png_file, filenames[i]);
+            bench_run(name, decode_png, &png_file, 1, upng_get_size(png));
+            snprintf(name, sizeof(name), "upng_decode %s (scalar)", filenames[i] + 9);
+            bench_run(name, decode_png_scalar, &png_file, 1, upng_get_size(png));
+            snprintf(name, sizeof(name), "texture_from_png %s", filenames[i] + 9);
+            bench_run(name, convert_png, png, 1, upng_get_size(png));
+        } else {
+            fprintf(stderr, "Can't decode %s, skipping.\n", filenames[i]);
+        }
+        upng_free(png);
+
+        free(png_file.data);
+    }
+}
@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <SDL2/SDL.h> // for M_PI
+
+#include "bench.h"
+#include "display.h"
+#include "triangle.h"
+#include "texture.h"
+#include "stats.h"
+#include "light.h"
+
+#define SCREEN_SIZE 1024
+
+// Each call clears the z-buffer, then draws a grid of copies of a triangle
+// several times, nearer each time so every layer passes the depth test (or
+// farther each time, so only the first does). The clear is benchmarked on
+// its own; it's well under 1% of a call.
+#define NUM_LAYERS 4
+
+typedef struct {
+    int size;               // length of the triangle's legs in pixels
+    texture_t *texture;     // NULL for flat shaded
+    depth_buffer_t *depth;  // depth only into this, instead of color
+    bool front_to_back;
+    bool shaded;            // Gouraud shaded, if not textured
+} raster_case_t;
+
+static void draw_layer(const raster_case_t *raster_case, float w) {
+    int size = raster_case->size;
+    int stride = size + 2;
+    for (int y = 0; y + stride <= SCREEN_SIZE; y += stride) {
+        for (int x = 0; x + stride <= SCREEN_SIZE; x += stride) {
+            if (raster_case->depth) {
+                draw_depth_triangle(
+                    raster_case->depth,
+                    x, y, w,
+                    x + size, y, w,
+                    x, y + size, w
+                );
+            } else if (raster_case->texture) {
+                draw_textured_triangle(
+                    x, y, 0, w, 0, 0,
+                    x + size, y, 0, w, 1, 0,
+                    x, y + size, 0, w, 0, 1,
+                    raster_case->texture
+                );
+            } else if (raster_case->shaded) {
+                draw_shaded_triangle(
+                    x, y, 0, w, 0,
+                    x + size, y, 0, w, LIGHT_ONE,
+                    x, y + size, 0, w, LIGHT_ONE / 2,
+                    0xFF808080
+                );
+            } else {
+                draw_filled_triangle(x, y, 0, w, x + size, y, 0, w, x, y + size, 0, w, 0xFF808080);
+            }
+        }
+    }
+}
+
+static void run_raster(void *arg) {
+    const raster_case_t *raster_case = arg;
+    if (raster_case->depth) {
+        clear_depth_buffer(raster_case->depth);
+    } else {
+        clear_z_buffer();
+    }
+    for (int layer = 0; layer < NUM_LAYERS; layer += 1) {
+        int depth = raster_case->front_to_back ? layer : NUM_LAYERS - 1 - layer;
+        draw_layer(raster_case, 2 + depth);
+    }
+}
+
+static void run_clear_z_buffer(void *arg) {
+    clear_z_buffer();
+}
+
+static void run_clear_and_draw_checker(void *arg) {
+    clear_color_buffer(0xFF000000);
+    draw_checker(45);
+    clear_z_buffer();
+}
+
+static void run_clear_frame_to_checker(void *arg) {
+    clear_frame_to_checker(0xFF000000, 45);
+}
+
+// A fan of lines from the middle of the screen in every direction, half of
+// them running far off it
+#define NUM_LINES 256
+
+static void run_lines(void *arg) {
+    for (int i = 0; i < NUM_LINES; i += 1) {
+        float angle = 2 * M_PI * i / NUM_LINES;
+        float length = i % 2 ? SCREEN_SIZE / 2 - 1 : SCREEN_SIZE * 4;
+        draw_line(
+            SCREEN_SIZE / 2, SCREEN_SIZE / 2,
+            SCREEN_SIZE / 2 + cosf(angle) * length, SCREEN_SIZE / 2 + sinf(angle) * length,
+            0xFFFFFFFF
+        );
+    }
+}
+
+// Bresenham's algorithm over the whole of a line, keeping the pixels that
+// land on the screen: what a clipped line should draw, give or take a pixel
+// where it enters and leaves
+static void draw_reference_line(uint8_t *mask, int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    while (true) {
+        if (x0 >= 0 && x0 < SCREEN_SIZE && y0 >= 0 && y0 < SCREEN_SIZE) mask[y0 * SCREEN_SIZE + x0] = 1;
+        if (x0 == x1 && y0 == y1) break;
+        int error2 = 2 * error;
+        if (error2 >= dy) {
+            error += dy;
+            x0 += step_x;
+        }
+        if (error2 <= dx) {
+            error += dx;
+            y0 += step_y;
+        }
+    }
+}
+
+// Whether any pixel next to (x, y), or it, is set
+static bool is_near_line(const uint8_t *mask, int x, int y) {
+    for (int ny = y - 1; ny <= y + 1; ny += 1) {
+        for (int nx = x - 1; nx <= x + 1; nx += 1) {
+            if (nx < 0 || nx >= SCREEN_SIZE || ny < 0 || ny >= SCREEN_SIZE) continue;
+            if (mask[ny * SCREEN_SIZE + nx]) return true;
+        }
+    }
+    return false;
+}
+
+// Lines clipped to the screen, through its sides and its corners, should
+// draw the pixels of the whole line that are on it, within a pixel
+static void check_clipped_lines(void) {
+    int last = SCREEN_SIZE - 1;
+    int lines[][4] = {
+        { -100, -1, last, last },                     // through the left side
+        { -10, -10, 20, 1 },                          // beyond two sides, through the top
+        { last + 50, -30, -40, last + 70 },           // corner to corner, beyond both
+        { -3000, 200, 4000, 900 },                    // beyond both sides
+        { 300, -2000, 700, 3000 },                    // beyond the top and bottom
+        { -20, 10, 10, -20 },                         // passes the corner, missing it
+        { last + 5, last - 20, last - 20, last + 5 }, // crosses the corner
+        { 100, 100, 900, 700 },                       // inside
+    };
+    int num_lines = sizeof(lines) / sizeof(lines[0]);
+
+    uint8_t *expected = malloc(SCREEN_SIZE * SCREEN_SIZE);
+    uint8_t *actual = malloc(SCREEN_SIZE * SCREEN_SIZE);
+    if (!expected || !actual) {
+        fprintf(stderr, "Can't allocate the line check, skipping it.\n");
+        free(expected);
+        free(actual);
+        return;
+    }
+
+    int num_wrong = 0;
+    for (int i = 0; i < num_lines; i += 1) {
+        int *line = lines[i];
+        memset(expected, 0, SCREEN_SIZE * SCREEN_SIZE);
+        draw_reference_line(expected, line[0], line[1], line[2], line[3]);
+
+        clear_color_buffer(0);
+        draw_line(line[0], line[1], line[2], line[3], 0xFFFFFFFF);
+        for (int y = 0; y < SCREEN_SIZE; y += 1) {
+            uint32_t *row = get_color_buffer_row(y);
+            for (int x = 0; x < SCREEN_SIZE; x += 1) {
+                actual[y * SCREEN_SIZE + x] = row[x] != 0;
+            }
+        }
+
+        bool matches = true;
+        for (int j = 0; j < SCREEN_SIZE * SCREEN_SIZE; j += 1) {
+            int x = j % SCREEN_SIZE, y = j / SCREEN_SIZE;
+            if (actual[j] && !is_near_line(expected, x, y)) matches = false;
+            if (expected[j] && !is_near_line(actual, x, y)) matches = false;
+        }
+        if (!matches) num_wrong += 1;
+    }
+    free(expected);
+    free(actual);
+
+    bench_check(num_wrong == 0, "clipped lines draw the on-screen pixels of the whole line");
+}
+
+static void bench_raster_case(const char *name, int size, texture_t *texture, depth_buffer_t *depth, bool front_to_back) {
+    raster_case_t raster_case = { size, texture, depth, front_to_back, strstr(name, "shaded") != NULL };
+    int per_row = SCREEN_SIZE / (size + 2);
+    int num_triangles = per_row * per_row * NUM_LAYERS;
+
+    // Count the pixels a call covers, for the throughput
+    begin_stats_frame();
+    run_raster(&raster_case);
+    end_stats_frame();
+    long num_pixels = get_frame_stats().pixels_covered;
+
+    char label[80];
+    snprintf(label, sizeof(label), "%s %dpx%s", name, size, front_to_back ? " (front to back)" : "");
+    bench_run_items(label, run_raster, &raster_case, num_triangles, num_pixels, "px");
+}
+
+// The depth-only rasterizer fills pixels by a different rule along edges,
+// but where both cover a pixel they should agree on its depth
+static void check_depth_triangle(void) {
+    int x0 = 100, y0 = 50, x1 = 700, y1 = 300, x2 = 250, y2 = 900;
+    float w0 = 2, w1 = 5, w2 = 9;
+
+    clear_z_buffer();
+    draw_filled_triangle(x0, y0, 0, w0, x1, y1, 0, w1, x2, y2, 0, w2, 0xFFFFFFFF);
+    const float *expected = get_z_buffer();
+
+    depth_buffer_t depth, depth16;
+    if (!init_depth_buffer(&depth, SCREEN_SIZE, SCREEN_SIZE, DEPTH_FLOAT32)) return;
+    if (!init_depth_buffer(&depth16, SCREEN_SIZE, SCREEN_SIZE, DEPTH_UNORM16)) {
+        free_depth_buffer(&depth);
+        return;
+    }
+    draw_depth_triangle(&depth, x0, y0, w0, x1, y1, w1, x2, y2, w2);
+    draw_depth_triangle(&depth16, x0, y0, w0, x1, y1, w1, x2, y2, w2);
+
+    const float *actual = depth.depth;
+    const uint16_t *actual16 = depth16.depth;
+    int num_differing = 0;
+    int num_only_one = 0;
+    float max_error = 0;
+    for (int i = 0; i < SCREEN_SIZE * SCREEN_SIZE; i += 1) {
+        bool covered = actual[i] < 1;
+        if (covered != (expected[i] < 1)) {
+            num_only_one += 1;
+        } else if (covered) {
+            float error = fabsf(actual[i] - expected[i]);
+            if (error > max_error) max_error = error;
+        }
+        if (fabsf(actual16[i] / 65535.0f - actual[i]) > 1 / 65535.0f) num_differing += 1;
+    }
+    free_depth_buffer(&depth);
+    free_depth_buffer(&depth16);
+
+    // A pixel either way along each edge at most
+    int perimeter = 600 + 700 + 900;
+    bench_check(num_only_one <= perimeter, "draw_depth_triangle covers the pixels draw_filled_triangle does");
+    bench_check(max_error < 1e-4, "draw_depth_triangle writes the depths draw_filled_triangle does");
+    bench_check(num_differing == 0, "unorm16 depths are within a step of float ones");
+}
+
+// Gouraud shading should cover the pixels flat shading does, leave them
+// unchanged when fully lit, and otherwise light each within a step or two of
+// the intensity interpolated exactly at it
+static void check_shaded_triangle(void) {
+    vec2_t a = { 100, 50 }, b = { 700, 300 }, c = { 250, 900 };
+    uint32_t *flat = malloc(SCREEN_SIZE * SCREEN_SIZE * sizeof(uint32_t));
+    if (!flat) {
+        fprintf(stderr, "Can't allocate the shading check, skipping it.\n");
+        return;
+    }
+
+    clear_color_buffer(0);
+    clear_z_buffer();
+    begin_raster_batch();
+    draw_filled_triangle(a.x, a.y, 0, 2, b.x, b.y, 0, 5, c.x, c.y, 0, 9, 0xFFFFFFFF);
+    for (int y = 0; y < SCREEN_SIZE; y += 1) {
+        memcpy(flat + y * SCREEN_SIZE, get_color_buffer_row(y), SCREEN_SIZE * sizeof(uint32_t));
+    }
+
+    clear_color_buffer(0);
+    clear_z_buffer();
+    draw_shaded_triangle(
+        a.x, a.y, 0, 2, LIGHT_ONE,
+        b.x, b.y, 0, 5, LIGHT_ONE,
+        c.x, c.y, 0, 9, LIGHT_ONE,
+        0xFFFFFFFF
+    );
+    bool unchanged = true;
+    for (int y = 0; y < SCREEN_SIZE; y += 1) {
+        if (memcmp(flat + y * SCREEN_SIZE, get_color_buffer_row(y), SCREEN_SIZE * sizeof(uint32_t))) unchanged = false;
+    }
+
+    float shades[3] = { 0, LIGHT_ONE, LIGHT_ONE / 4 };
+    clear_color_buffer(0);
+    clear_z_buffer();
+    draw_shaded_triangle(
+        a.x, a.y, 0, 2, shades[0],
+        b.x, b.y, 0, 5, shades[1],
+        c.x, c.y, 0, 9, shades[2],
+        0xFFFFFFFF
+    );
+    bool covered = true;
+    int max_error = 0;
+    for (int y = 0; y < SCREEN_SIZE; y += 1) {
+        uint32_t *row = get_color_buffer_row(y);
+        for (int x = 0; x < SCREEN_SIZE; x += 1) {
+            uint32_t expected_alpha = flat[y * SCREEN_SIZE + x] & 0xFF000000;
+            if ((row[x] & 0xFF000000) != expected_alpha) covered = false;
+            if (!expected_alpha) continue;
+
+            vec3_t weights = barycentric_weights(a, b, c, (vec2_t) { x, y });
+            float shade = weights.x * shades[0] + weights.y * shades[1] + weights.z * shades[2];
+            int expected = (int)(255 * fminf(fmaxf(shade, 0), LIGHT_ONE)) >> 8;
+            int error = abs((int)(row[x] & 0xFF) - expected);
+            if (error > max_error) max_error = error;
+        }
+    }
+    free(flat);
+
+    printf("%-40s %11d steps max\n", "draw_shaded_triangle", max_error);
+    bench_check(unchanged, "fully lit Gouraud shading matches flat shading");
+    bench_check(covered, "draw_shaded_triangle covers the pixels draw_filled_triangle does");
+    bench_check(max_error <= 2, "Gouraud shading stays within 2 steps of exact");
+}
+
+// Draw a triangle whose depth changes across its spans with a texture whose
+// texels hold their own coordinates, so each pixel shows which texel it
+// sampled; write them to texels_sampled
+#define CODED_TEXTURE_SIZE 256
+
+static void draw_coded_triangle(texture_t *texture, uint32_t *texels_sampled) {
+    clear_color_buffer(0);
+    clear_z_buffer();
+    begin_raster_batch();
+    draw_textured_triangle(
+        50, 50, 0, 1, 0.05, 0.05,
+        1000, 100, 0, 12, 0.95, 0.05,
+        100, 1000, 0, 4, 0.05, 0.95,
+        texture
+    );
+    for (int y = 0; y < SCREEN_SIZE; y += 1) {
+        memcpy(texels_sampled + y * SCREEN_SIZE, get_color_buffer_row(y), SCREEN_SIZE * sizeof(uint32_t));
+    }
+}
+
+// How far, in texels, the cheaper texture mappings stray from the exact one
+static void check_texture_mapping(void) {
+    texture_t texture = { CODED_TEXTURE_SIZE, CODED_TEXTURE_SIZE, NULL };
+    texture.texels = malloc(CODED_TEXTURE_SIZE * CODED_TEXTURE_SIZE * sizeof(uint32_t));
+    uint32_t *exact = malloc(SCREEN_SIZE * SCREEN_SIZE * sizeof(uint32_t));
+    uint32_t *actual = malloc(SCREEN_SIZE * SCREEN_SIZE * sizeof(uint32_t));
+    if (!texture.texels || !exact || !actual) {
+        fprintf(stderr, "Can't allocate the texture mapping check, skipping it.\n");
+        free(texture.texels);
+        free(exact);
+        free(actual);
+        return;
+    }
+    for (int y = 0; y < CODED_TEXTURE_SIZE; y += 1) {
+        for (int x = 0; x < CODED_TEXTURE_SIZE; x += 1) {
+            texture.texels[y * CODED_TEXTURE_SIZE + x] = 0xFF000000 | (y << 8) | x;
+        }
+    }
+
+    set_texture_mapping(TEXTURE_PERSPECTIVE);
+    draw_coded_triangle(&texture, exact);
+
+    struct { const char *name; int mapping; int subdivision; } cases[] = {
+        { "subdivided 8", TEXTURE_SUBDIVIDED, 8 },
+        { "subdivided 16", TEXTURE_SUBDIVIDED, 16 },
+        { "subdivided 32", TEXTURE_SUBDIVIDED, 32 },
+        { "affine", TEXTURE_AFFINE, 0 },
+    };
+    int num_cases = sizeof(cases) / sizeof(cases[0]);
+    int max_errors[sizeof(cases) / sizeof(cases[0])];
+    for (int c = 0; c < num_cases; c += 1) {
+        set_texture_mapping(cases[c].mapping);
+        if (cases[c].subdivision) set_texture_subdivision(cases[c].subdivision);
+        draw_coded_triangle(&texture, actual);
+
+        int max_error = 0;
+        long total_error = 0;
+        long num_pixels = 0;
+        for (int i = 0; i < SCREEN_SIZE * SCREEN_SIZE; i += 1) {
+            if (!exact[i] || !actual[i]) continue;
+            int dx = abs((int)(exact[i] & 0xFF) - (int)(actual[i] & 0xFF));
+            int dy = abs((int)((exact[i] >> 8) & 0xFF) - (int)((actual[i] >> 8) & 0xFF));
+            int error = dx > dy ? dx : dy;
+            if (error > max_error) max_error = error;
+            total_error += error;
+            num_pixels += 1;
+        }
+        max_errors[c] = max_error;
+        printf("%-40s %11d texels max, %.3f mean\n", cases[c].name, max_error,
+            num_pixels ? (double)total_error / num_pixels : 0.0);
+    }
+
+    set_texture_mapping(TEXTURE_PERSPECTIVE);
+    set_texture_subdivision(16);
+    begin_raster_batch();
+    free(texture.texels);
+    free(exact);
+    free(actual);
+
+    bench_check(max_errors[1] <= 2, "subdivided texturing (16 pixels) stays within 2 texels of exact");
+    bench_check(max_errors[2] < max_errors[3], "subdivided texturing is closer to exact than affine");
+}
+
+void bench_raster(void) {
+    set_display_backend(DISPLAY_HEADLESS);
+    set_internal_resolution(SCREEN_SIZE, SCREEN_SIZE);
+    if (!initialize_window()) {
+        fprintf(stderr, "Can't create a headless display, skipping raster benchmarks.\n");
+        return;
+    }
+
+    bench_run_items("clear_z_buffer", run_clear_z_buffer, NULL, 1, SCREEN_SIZE * SCREEN_SIZE, "px");
+    bench_run_items("clear + draw_checker + clear_z", run_clear_and_draw_checker, NULL, 1, SCREEN_SIZE * SCREEN_SIZE, "px");
+    bench_run_items("clear_frame_to_checker", run_clear_frame_to_checker, NULL, 1, SCREEN_SIZE * SCREEN_SIZE, "px");
+
+    check_clipped_lines();
+    bench_run_items("draw_line", run_lines, NULL, NUM_LINES, NUM_LINES * SCREEN_SIZE / 2, "px");
+
+    int sizes[] = { 8, 64, 256 };
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+    for (int i = 0; i < num_sizes; i += 1) {
+        bench_raster_case("draw_filled_triangle", sizes[i], NULL, NULL, false);
+    }
+    bench_raster_case("draw_filled_triangle", 64, NULL, NULL, true);
+
+    check_shaded_triangle();
+    for (int i = 0; i < num_sizes; i += 1) {
+        bench_raster_case("draw_shaded_triangle", sizes[i], NULL, NULL, false);
+    }
+
+    // Depth only, into the z-buffer and a 16-bit buffer of the same size
+    check_depth_triangle();
+    depth_buffer_t z_buffer = get_z_buffer_target();
+    depth_buffer_t depth16;
+    if (init_depth_buffer(&depth16, SCREEN_SIZE, SCREEN_SIZE, DEPTH_UNORM16)) {
+        for (int i = 0; i < num_sizes; i += 1) {
+            bench_raster_case("draw_depth_triangle", sizes[i], NULL, &z_buffer, false);
+        }
+        bench_raster_case("draw_depth_triangle", 64, NULL, &z_buffer, true);
+        for (int i = 0; i < num_sizes; i += 1) {
+            bench_raster_case("draw_depth_triangle unorm16", sizes[i], NULL, &depth16, false);
+        }
+        free_depth_buffer(&depth16);
+    }
+
+    check_texture_mapping();
+
+    texture_t *texture = load_png_texture("./assets/f22.png");
+    if (texture) {
+        for (int i = 0; i < num_sizes; i += 1) {
+            bench_raster_case("draw_textured_triangle", sizes[i], texture, NULL, false);
+        }
+        bench_raster_case("draw_textured_triangle", 64, texture, NULL, true);
+
+        // The other specialized span variants
+        set_texture_mapping(TEXTURE_SUBDIVIDED);
+        begin_raster_batch();
+        bench_raster_case("draw_textured_triangle subdivided", 64, texture, NULL, false);
+        bench_raster_case("draw_textured_triangle subdivided", 256, texture, NULL, false);
+        set_texture_mapping(TEXTURE_AFFINE);
+        begin_raster_batch();
+        bench_raster_case("draw_textured_triangle affine", 64, texture, NULL, false);
+        bench_raster_case("draw_textured_triangle affine", 256, texture, NULL, false);
+        set_texture_mapping(TEXTURE_PERSPECTIVE);
+        set_depth_test(false);
+        begin_raster_batch();
+        bench_raster_case("draw_textured_triangle no depth test", 64, texture, NULL, false);
+        set_depth_test(true);
+        begin_raster_batch();
+        free_texture(texture);
+    } else {
+        fprintf(stderr, "Can't load ./assets/f22.png, skipping textured raster benchmarks.\n");
+    }
+
+    destroy_window();
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "benchmark.h"
+#include "array.h"
+#include "camera.h"
+#include "display.h"
+#include "mesh.h"
+#include "profile.h"
+#include "stats.h"
+
+#define MAX_BUFFER_SIZE 512
+
+typedef struct {
+    float time;
+    vec3_t position;
+    float yaw;
+    float pitch;
+} camera_keyframe_t;
+
+typedef struct {
+    const char *name;
+    int mode;
+} mode_name_t;
+
+static const mode_name_t mode_names[] = {
+    { "dot", MODE_DOT },
+    { "wire", MODE_WIRE },
+    { "wiredot", MODE_WIREDOT },
+    { "solid", MODE_SOLID },
+    { "solidwire", MODE_SOLIDWIRE },
+    { "texture", MODE_TEXTURE },
+    { "texturewire", MODE_TEXTUREWIRE },
+};
+
+static char scene_filename[MAX_BUFFER_SIZE];
+static float delta_time = 1.0 / 60;
+static float scene_time = 0;
+static camera_keyframe_t *keyframes = NULL;
+static vec3_t rotations[MAX_NUMBER_MESHES];
+static vec3_t spins[MAX_NUMBER_MESHES];
+
+// Frame and per-stage times of every frame, in milliseconds (stage times
+// only with the profiler compiled in)
+static double *frame_samples = NULL;
+static double *stage_samples[NUM_PROFILE_STAGES];
+static double *stat_samples[NUM_PIPELINE_STATS];
+
+bool load_benchmark_scene(char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening scene %s.\n", filename);
+        return false;
+    }
+    snprintf(scene_filename, sizeof(scene_filename), "%s", filename);
+
+    char line[MAX_BUFFER_SIZE];
+    int line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line_number += 1;
+
+        char directive[16];
+        if (sscanf(line, "%15s", directive) != 1 || directive[0] == '#') continue;
+
+        if (strcmp(directive, "dt") == 0) {
+            ok = sscanf(line, "%*s %f", &delta_time) == 1 && delta_time > 0;
+        } else if (strcmp(directive, "mode") == 0) {
+            char name[16];
+            ok = false;
+            if (sscanf(line, "%*s %15s", name) == 1) {
+                for (int i = 0; i < (int)(sizeof(mode_names) / sizeof(mode_names[0])); i += 1) {
+                    if (strcmp(name, mode_names[i].name) == 0) {
+                        set_render_mode(mode_names[i].mode);
+                        ok = true;
+                    }
+                }
+            }
+        } else if (strcmp(directive, "cull") == 0) {
+            char setting[8];
+            ok = sscanf(line, "%*s %7s", setting) == 1
+                && (strcmp(setting, "on") == 0 || strcmp(setting, "off") == 0);
+            if (ok) set_cull_backfaces(strcmp(setting, "on") == 0);
+        } else if (strcmp(directive, "mesh") == 0) {
+            char obj_filename[MAX_BUFFER_SIZE];
+            char png_filename[MAX_BUFFER_SIZE];
+            vec3_t position;
+            float scale = 1;
+            int count = sscanf(line, "%*s %511s %511s %f %f %f %f",
+                obj_filename, png_filename, &position.x, &position.y, &position.z, &scale);
+            ok = count >= 5 && get_num_meshes() < MAX_NUMBER_MESHES;
+            if (ok) {
+                rotations[get_num_meshes()] = vec3_new(0, 0, 0);
+                spins[get_num_meshes()] = vec3_new(0, 0, 0);
+                load_mesh(obj_filename, png_filename, vec3_new(scale, scale, scale), position, vec3_new(0, 0, 0));
+            }
+        } else if (strcmp(directive, "rotate") == 0) {
+            vec3_t rotation;
+            ok = sscanf(line, "%*s %f %f %f", &rotation.x, &rotation.y, &rotation.z) == 3 && get_num_meshes() > 0;
+            if (ok) rotations[get_num_meshes() - 1] = rotation;
+        } else if (strcmp(directive, "spin") == 0) {
+            vec3_t spin;
+            ok = sscanf(line, "%*s %f %f %f", &spin.x, &spin.y, &spin.z) == 3 && get_num_meshes() > 0;
+            if (ok) spins[get_num_meshes() - 1] = spin;
+        } else if (strcmp(directive, "camera") == 0) {
+            camera_keyframe_t keyframe;
+            ok = sscanf(line, "%*s %f %f %f %f %f %f", &keyframe.time,
+                &keyframe.position.x, &keyframe.position.y, &keyframe.position.z,
+                &keyframe.yaw, &keyframe.pitch) == 6;
+            if (ok) array_push(keyframes, keyframe);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s:%d: invalid directive: %s", filename, line_number, line);
+        }
+    }
+    fclose(file);
+
+    // Don't time frames drawn while textures are still being decoded
+    wait_mesh_textures();
+
+    return ok;
+}
+
+float get_benchmark_delta_time(void) {
+    return delta_time;
+}
+
+static float lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+// Place the camera and meshes for the current time, then advance it
+void update_benchmark_scene(void) {
+    int num_keyframes = array_length(keyframes);
+    if (num_keyframes > 0) {
+        // Find the keyframes before and after the current time
+        int next = 0;
+        while (next < num_keyframes && keyframes[next].time <= scene_time) next += 1;
+        camera_keyframe_t a = keyframes[next > 0 ? next - 1 : 0];
+        camera_keyframe_t b = keyframes[next < num_keyframes ? next : num_keyframes - 1];
+
+        float t = b.time > a.time ? (scene_time - a.time) / (b.time - a.time) : 0;
+        if (t < 0) t = 0;
+        if (t > 1) t = 1;
+        set_camera_position(vec3_new(
+            lerp(a.position.x, b.position.x, t),
+            lerp(a.position.y, b.position.y, t),
+            lerp(a.position.z, b.position.z, t)
+        ));
+        set_camera_yaw(lerp(a.yaw, b.yaw, t));
+        set_camera_pitch(lerp(a.pitch, b.pitch, t));
+    }
+
+    // Rotations are computed from the time rather than accumulated, so they
+    // don't drift with float error
+    for (int i = 0; i < get_num_meshes(); i += 1) {
+        get_mesh(i)->rotation = vec3_add(rotations[i], vec3_mul(spins[i], scene_time));
+    }
+
+    scene_time += delta_time;
+}
+
+// Record a frame's time, as measured by the caller, with its stage times
+// and pipeline stats
+void record_benchmark_frame(double frame_ms) {
+    array_push(frame_samples, frame_ms);
+#if PROFILER
+    for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+        array_push(stage_samples[i], get_profile_stage_ms(i));
+    }
+#endif
+    pipeline_stats_t stats = get_frame_stats();
+    for (int i = 0; i < (int)NUM_PIPELINE_STATS; i += 1) {
+        array_push(stat_samples[i], (double)get_pipeline_stat(&stats, i));
+    }
+}
+
+typedef struct {
+    double avg;
+    double p50;
+    double p95;
+    double p99;
+} summary_t;
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(double *sorted, int count, double p) {
+    int rank = (int)ceil(p / 100 * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+static summary_t summarize(double *samples) {
+    summary_t summary = { 0 };
+    int count = array_length(samples);
+    if (count == 0) return summary;
+
+    double *sorted = malloc(sizeof(double) * count);
+    memcpy(sorted, samples, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), compare_doubles);
+
+    for (int i = 0; i < count; i += 1) {
+        summary.avg += sorted[i];
+    }
+    summary.avg /= count;
+    summary.p50 = percentile(sorted, count, 50);
+    summary.p95 = percentile(sorted, count, 95);
+    summary.p99 = percentile(sorted, count, 99);
+
+    free(sorted);
+    return summary;
+}
+
+static void write_json_summary(FILE *file, const char *indent, const char *name, summary_t s, const char *end) {
+    fprintf(file, "%s\"%s\": { \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }%s\n",
+        indent, name, s.avg, s.p50, s.p95, s.p99, end);
+}
+
+// Summaries of the frame and stage times in milliseconds and of the pipeline
+// stats per frame, as CSV if the filename ends in .csv and JSON otherwise (on
+// stdout if it's NULL)
+bool write_benchmark_report(char *filename) {
+    FILE *file = filename ? fopen(filename, "w") : stdout;
+    if (!file) {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return false;
+    }
+
+    const char *extension = filename ? strrchr(filename, '.') : NULL;
+    if (extension && strcmp(extension, ".csv") == 0) {
+        fprintf(file, "name,unit,avg,p50,p95,p99\n");
+        summary_t s = summarize(frame_samples);
+        fprintf(file, "frame,ms,%.4f,%.4f,%.4f,%.4f\n", s.avg, s.p50, s.p95, s.p99);
+#if PROFILER
+        for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+            s = summarize(stage_samples[i]);
+            fprintf(file, "%s,ms,%.4f,%.4f,%.4f,%.4f\n", get_profile_stage_name(i), s.avg, s.p50, s.p95, s.p99);
+        }
+#endif
+        for (int i = 0; i < (int)NUM_PIPELINE_STATS; i += 1) {
+            s = summarize(stat_samples[i]);
+            fprintf(file, "%s,count,%.1f,%.0f,%.0f,%.0f\n", get_pipeline_stat_name(i), s.avg, s.p50, s.p95, s.p99);
+        }
+    } else {
+        fprintf(file, "{\n");
+        fprintf(file, "  \"scene\": \"%s\",\n", scene_filename);
+        fprintf(file, "  \"frames\": %d,\n", array_length(frame_samples));
+        fprintf(file, "  \"width\": %d,\n", get_window_width());
+        fprintf(file, "  \"height\": %d,\n", get_window_height());
+        fprintf(file, "  \"delta_time\": %f,\n", delta_time);
+        fprintf(file, "  \"zero_copy\": %s,\n", get_zero_copy() ? "true" : "false");
+        write_json_summary(file, "  ", "frame_ms", summarize(frame_samples), ",");
+#if PROFILER
+        fprintf(file, "  \"stages_ms\": {\n");
+        for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+            write_json_summary(file, "    ", get_profile_stage_name(i), summarize(stage_samples[i]),
+                i < NUM_PROFILE_STAGES - 1 ? "," : "");
+        }
+        fprintf(file, "  },\n");
+#endif
+        fprintf(file, "  \"stats_per_frame\": {\n");
+        for (int i = 0; i < (int)NUM_PIPELINE_STATS; i += 1) {
+            write_json_summary(file, "    ", get_pipeline_stat_name(i), summarize(stat_samples[i]),
+                i < (int)NUM_PIPELINE_STATS - 1 ? "," : "");
+        }
+        fprintf(file, "  }\n");
+        fprintf(file, "}\n");
+    }
+
+    bool ok = !ferror(file);
+    if (filename) fclose(file);
+    return ok;
+}
+
+// The scene file name of a render mode, or NULL if it has none
+const char *get_render_mode_name(int mode) {
+    for (int i = 0; i < (int)(sizeof(mode_names) / sizeof(mode_names[0])); i += 1) {
+        if (mode_names[i].mode == mode) return mode_names[i].name;
+    }
+    return NULL;
+}
+
+void free_benchmark(void) {
+    array_free(keyframes);
+    array_free(frame_samples);
+    for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+        array_free(stage_samples[i]);
+    }
+    for (int i = 0; i < (int)NUM_PIPELINE_STATS; i += 1) {
+        array_free(stat_samples[i]);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Deterministic benchmark runs
+//
+// A scene file sets up the meshes and a camera path, one directive per line
+// (# starts a comment):
+//     dt <seconds>                              fixed time step, 1/60 by default
+//     mode <dot|wire|wiredot|solid|solidwire|texture|texturewire>
+//     cull <on|off>
+//     mesh <obj> <png> <x> <y> <z> [scale]      add a mesh at a position
+//     rotate <x> <y> <z>                        last mesh's initial rotation (rad)
+//     spin <x> <y> <z>                          last mesh's rotation speed (rad/s)
+//     camera <time> <x> <y> <z> <yaw> <pitch>   camera keyframe, in time order
+// The camera moves linearly between keyframes and holds at the last one.
+//
+// Every frame advances time by the fixed step, so runs replay identically
+// regardless of how fast frames are produced.
+
+bool load_benchmark_scene(char *filename);
+float get_benchmark_delta_time(void);
+void update_benchmark_scene(void);
+void record_benchmark_frame(double frame_ms);
+bool write_benchmark_report(char *filename);
+void free_benchmark(void);
+const char *get_render_mode_name(int mode);
@@ -52,13 +52,18 @@ float float_lerp(float a, float b, float t) {
     return a + t * (b - a);
 }
 
-void clip_polygon_against_plane(polygon_t *polygon, int plane) {
+// Returns whether the plane cut the polygon (i.e. any vertex was outside)
+bool clip_polygon_against_plane(polygon_t *polygon, int plane) {
+    // Nothing left to clip once a previous plane rejected everything
+    if (polygon->num_vertices == 0) return false;
+
     vec3_t plane_point = frustum_planes[plane].point;
     vec3_t plane_normal = frustum_planes[plane].normal;
 
     // The array of inside vertices that will be part of the final polygon returned via parameter
     vec3_t inside_vertices[MAX_NUM_POLY_VERTICES];
     tex2_t inside_texcoords[MAX_NUM_POLY_VERTICES];
+    float inside_intensities[MAX_NUM_POLY_VERTICES];
     int num_inside_vertices = 0;
 
     // Start current and previous vertex with the first and last polygon vertices
@@ -66,6 +71,11 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane) {
     vec3_t *previous_vertex = &polygon->vertices[polygon->num_vertices - 1];
     tex2_t *current_texcoord = &polygon->texcoords[0];
     tex2_t *previous_texcoord = &polygon->texcoords[polygon->num_vertices - 1];
+    float *current_intensity = &polygon->intensities[0];
+    float *previous_intensity = &polygon->intensities[polygon->num_vertices - 1];
+
+    // Whether any vertex was left out, i.e. the plane changed the polygon
+    bool cut = false;
 
     // Compute the dot product to determine which partition the vertex exists in
     float current_dot = 0;
@@ -96,6 +106,7 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane) {
             // Insert the new intersection point in the list of "inside vertices"
             inside_vertices[num_inside_vertices] = vec3_clone(&intersection_point);
             inside_texcoords[num_inside_vertices] = tex2_clone(&interpolated_texcoord);
+            inside_intensities[num_inside_vertices] = float_lerp(*previous_intensity, *current_intensity, t);
             num_inside_vertices += 1;
         }
 
@@ -104,23 +115,31 @@ void clip_polygon_against_plane(polygon_t *polygon, int plane) {
             // Insert current vertex in the list of "inside vertices"
             inside_vertices[num_inside_vertices] = vec3_clone(current_vertex);
             inside_texcoords[num_inside_vertices] = tex2_clone(current_texcoord);
+            inside_intensities[num_inside_vertices] = *current_intensity;
             num_inside_vertices += 1;
+        } else {
+            cut = true;
         }
 
         // Move to the next vertex
         previous_dot = current_dot;
         previous_vertex = current_vertex;
         previous_texcoord = current_texcoord;
+        previous_intensity = current_intensity;
         current_vertex += 1;
         current_texcoord += 1;
+        current_intensity += 1;
     }
 
     // Copy all the vertices from the inside_vertices into the destination polygon (out parameter)
     for (int i = 0; i < num_inside_vertices; i += 1) {
         polygon->vertices[i] = vec3_clone(&inside_vertices[i]);
         polygon->texcoords[i] = tex2_clone(&inside_texcoords[i]);
+        polygon->intensities[i] = inside_intensities[i];
     } 
     polygon->num_vertices = num_inside_vertices;
+
+    return cut;
 }
 
 void triangles_from_polygon(polygon_t *polygon, triangle_t triangles[], int *num_triangles) {
@@ -135,15 +154,60 @@ void triangles_from_polygon(polygon_t *polygon, triangle_t triangles[], int *num
         triangles[i].texcoords[0] = polygon->texcoords[index0];
         triangles[i].texcoords[1] = polygon->texcoords[index1];
         triangles[i].texcoords[2] = polygon->texcoords[index2];
+        triangles[i].intensities[0] = polygon->intensities[index0];
+        triangles[i].intensities[1] = polygon->intensities[index1];
+        triangles[i].intensities[2] = polygon->intensities[index2];
     }
     *num_triangles = polygon->num_vertices - 2;
 }
 
-void clip_polygon(polygon_t *polygon) {
-    clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
-    clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+// Clip the polygon (in place) against every frustum plane, returning whether
+// any of them cut it
+bool clip_polygon(polygon_t *polygon) {
+    bool cut = false;
+    cut |= clip_polygon_against_plane(polygon, LEFT_FRUSTUM_PLANE);
+    cut |= clip_polygon_against_plane(polygon, RIGHT_FRUSTUM_PLANE);
+    cut |= clip_polygon_against_plane(polygon, TOP_FRUSTUM_PLANE);
+    cut |= clip_polygon_against_plane(polygon, BOTTOM_FRUSTUM_PLANE);
+    cut |= clip_polygon_against_plane(polygon, NEAR_FRUSTUM_PLANE);
+    cut |= clip_polygon_against_plane(polygon, FAR_FRUSTUM_PLANE);
+    return cut;
+}
+
+// The signed distance of a point from a frustum plane, positive inside
+static float plane_distance(vec3_t point, int plane) {
+    return vec3_dot(vec3_sub(point, frustum_planes[plane].point), frustum_planes[plane].normal);
+}
+
+// Clip the segment from a to b (in place) against every frustum plane,
+// returning false if none of it is inside
+bool clip_segment(vec3_t *a, vec3_t *b) {
+    for (int plane = 0; plane < NUM_PLANES; plane += 1) {
+        float dot_a = plane_distance(*a, plane);
+        float dot_b = plane_distance(*b, plane);
+        if (dot_a <= 0 && dot_b <= 0) return false;
+
+        // Move the end outside the plane to where the segment crosses it
+        if (dot_a < 0 || dot_b < 0) {
+            float t = dot_a / (dot_a - dot_b);
+            vec3_t intersection_point = {
+                .x = float_lerp(a->x, b->x, t),
+                .y = float_lerp(a->y, b->y, t),
+                .z = float_lerp(a->z, b->z, t)
+            };
+            if (dot_a < 0) {
+                *a = intersection_point;
+            } else {
+                *b = intersection_point;
+            }
+        }
+    }
+    return true;
+}
+
+bool is_point_in_frustum(vec3_t point) {
+    for (int plane = 0; plane < NUM_PLANES; plane += 1) {
+        if (plane_distance(point, plane) <= 0) return false;
+    }
+    return true;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "triangle.h"
 #include "vector.h"
 
@@ -23,10 +25,13 @@ typedef struct {
 typedef struct {
     vec3_t vertices[MAX_NUM_POLY_VERTICES];
     tex2_t texcoords[MAX_NUM_POLY_VERTICES];
+    float intensities[MAX_NUM_POLY_VERTICES]; // for Gouraud shading, if used
     int num_vertices;
 } polygon_t;
 
 void init_frustum_planes(float fovy, float fovx, float znear, float zfar);
 polygon_t create_polygon_from_triangle(vec3_t v0, vec3_t v1, vec3_t v2, tex2_t t0, tex2_t t1, tex2_t t2);
 void triangles_from_polygon(polygon_t *polygon, triangle_t triangles[], int *num_triangles);
-void clip_polygon(polygon_t *polygon);
+bool clip_polygon(polygon_t *polygon);
+bool clip_segment(vec3_t *a, vec3_t *b);
+bool is_point_in_frustum(vec3_t point);
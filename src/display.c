@@ -1,20 +1,75 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
 #include <SDL2/SDL.h> 
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define DISPLAY_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DISPLAY_NEON
+#endif
+
 #include "display.h"
+#include "image.h"
+#include "font.h"
+#include "jobs.h"
 
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
-static uint32_t *color_buffer = NULL;
+static uint32_t *color_buffer = NULL;       // where the frame is drawn
+static uint32_t *owned_color_buffer = NULL; // ours, copied to the texture to present
+static int color_pitch = 0;                 // pixels from one row to the next
 static float *z_buffer = NULL;
 static SDL_Texture* color_buffer_texture = NULL;
-static int window_width = 800;
-static int window_height = 600;
+// The internal resolution frames are drawn at, scaled up to the window when
+// presenting. It can be lowered at runtime, down to drawing into the top
+// left corner of buffers (and texture) allocated for the starting size.
+static int window_width = 0;
+static int window_height = 0;
+static int buffer_width = 0;
+static int buffer_height = 0;
+
+static int display_backend = DISPLAY_SDL;
+static char frame_dump_pattern[256] = "";
+static int frame_number = 0;
 
 static int render_mode = 0;
 static bool cull_backfaces = true;
 static bool show_depth = false;
+static bool depth_test = true;
+static int texture_mapping = TEXTURE_PERSPECTIVE;
+static int texture_subdivision = 16;
+static int shading = SHADING_FLAT;
+static bool wire_depth_test = false;
+
+// Depth tested lines lie right on the edges of filled triangles, so they're
+// let through a little behind the z-buffer to avoid z-fighting with them
+#define LINE_DEPTH_BIAS 0.001f
+
+// Draw straight into the locked streaming texture instead of copying our
+// buffer into it when presenting
+static bool zero_copy = false;
+static bool color_buffer_locked = false;
+
+// Per-pixel counts for the heatmap view, only allocated once it's enabled
+static int heatmap_mode = HEATMAP_OFF;
+static uint8_t *heatmap = NULL;
+
+#define CHECKER_COLOR 0xFF151515
+
+// The checkerboard background, drawn once for the resolution and colors it
+// was last asked for and copied to clear each frame
+static uint32_t *background = NULL;
+static int background_width = 0;
+static int background_height = 0;
+static uint32_t background_color = 0;
+static int background_tilesize = 0;
+
+// Frames are cleared in bands of rows, in parallel on the worker pool
+#define CLEAR_BAND_HEIGHT 32
 
 int get_window_width(void) {
     return window_width;
@@ -56,7 +111,161 @@ void toggle_show_depth(void) {
     show_depth = !show_depth;
 }
 
-bool initialize_window(void) {
+// Without the depth test, triangles are drawn over each other in the order
+// they come (and the z-buffer is left alone)
+bool get_depth_test(void) {
+    return depth_test;
+}
+
+void set_depth_test(bool setting) {
+    depth_test = setting;
+}
+
+void toggle_depth_test(void) {
+    depth_test = !depth_test;
+}
+
+// Affine texturing interpolates UVs linearly across the screen, which is
+// cheaper but warps textures on triangles at an angle to the view.
+// Subdivided texturing is exact every few pixels and affine in between,
+// trading a little accuracy for most of the cost of the exact divides.
+int get_texture_mapping(void) {
+    return texture_mapping;
+}
+
+void set_texture_mapping(int mapping) {
+    texture_mapping = mapping;
+}
+
+// Perspective, subdivided, affine, and back to perspective
+void cycle_texture_mapping(void) {
+    texture_mapping = (texture_mapping + 1) % (TEXTURE_AFFINE + 1);
+}
+
+// Pixels between the exact points of subdivided texturing
+int get_texture_subdivision(void) {
+    return texture_subdivision;
+}
+
+void set_texture_subdivision(int pixels) {
+    texture_subdivision = pixels < 1 ? 1 : pixels;
+}
+
+int get_shading(void) {
+    return shading;
+}
+
+void set_shading(int setting) {
+    shading = setting;
+}
+
+// Flat, Gouraud, and back to flat
+void cycle_shading(void) {
+    shading = (shading + 1) % (SHADING_GOURAUD + 1);
+}
+
+// Depth test wireframes over filled triangles, hiding edges behind them
+bool get_wire_depth_test(void) {
+    return wire_depth_test;
+}
+
+void set_wire_depth_test(bool setting) {
+    wire_depth_test = setting;
+}
+
+void toggle_wire_depth_test(void) {
+    wire_depth_test = !wire_depth_test;
+}
+
+int get_heatmap_mode(void) {
+    return heatmap_mode;
+}
+
+void set_heatmap_mode(int mode) {
+    if (mode != HEATMAP_OFF && !heatmap) {
+        heatmap = calloc(buffer_width * buffer_height, sizeof(uint8_t));
+        if (!heatmap) {
+            fprintf(stderr, "Error allocating the heatmap.\n");
+            return;
+        }
+    }
+    heatmap_mode = mode;
+}
+
+// Off, overdraw, depth complexity, and back to off
+void cycle_heatmap_mode(void) {
+    set_heatmap_mode((heatmap_mode + 1) % (HEATMAP_DEPTH_COMPLEXITY + 1));
+}
+
+bool get_zero_copy(void) {
+    return zero_copy;
+}
+
+void set_zero_copy(bool setting) {
+    zero_copy = setting;
+}
+
+int get_display_backend(void) {
+    return display_backend;
+}
+
+void set_display_backend(int backend) {
+    display_backend = backend;
+}
+
+// The starting internal resolution, before the window is initialized. The
+// headless backend requires one; in a window it defaults to half the display.
+void set_internal_resolution(int width, int height) {
+    window_width = width;
+    window_height = height;
+}
+
+// The largest internal resolution, the one the buffers were allocated for
+int get_max_render_width(void) {
+    return buffer_width;
+}
+
+int get_max_render_height(void) {
+    return buffer_height;
+}
+
+// Change the internal resolution between frames, within the buffers
+void set_render_resolution(int width, int height) {
+    if (color_buffer_locked) return;
+
+    window_width = width < 1 ? 1 : width > buffer_width ? buffer_width : width;
+    window_height = height < 1 ? 1 : height > buffer_height ? buffer_height : height;
+}
+
+// Whether a frame dump pattern is safe to hand to snprintf: exactly one
+// integer conversion (%d, optionally zero padded to a width, e.g. %04d), and
+// otherwise only %% escapes
+static bool is_frame_dump_pattern(const char *pattern) {
+    int num_conversions = 0;
+    for (const char *c = pattern; *c; c += 1) {
+        if (*c != '%') continue;
+        c += 1;
+        if (*c == '%') continue;
+        if (*c == '0') c += 1;
+        while (*c >= '0' && *c <= '9') c += 1;
+        if (*c != 'd') return false;
+        num_conversions += 1;
+    }
+    return num_conversions == 1;
+}
+
+// Headless frames are written to files named by a printf pattern taking the
+// frame number (e.g. "frame%04d.png"), or discarded if it's NULL. Returns
+// false, leaving dumping off, for a pattern without exactly one %d.
+bool set_frame_dump(char *pattern) {
+    frame_dump_pattern[0] = '\0';
+    if (!pattern) return true;
+    if (!is_frame_dump_pattern(pattern) || strlen(pattern) >= sizeof(frame_dump_pattern)) return false;
+    snprintf(frame_dump_pattern, sizeof(frame_dump_pattern), "%s", pattern);
+    return true;
+}
+
+static bool initialize_sdl_window(void) {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         fprintf(stderr, "Error initializing SDL.\n");
         return false;
@@ -68,8 +277,10 @@ bool initialize_window(void) {
     int fullscreen_width = display_mode.w;
     int fullscreen_height = display_mode.h;
 
-    window_width = fullscreen_width / 2;
-    window_height = fullscreen_height / 2;
+    if (window_width <= 0 || window_height <= 0) {
+        window_width = fullscreen_width / 2;
+        window_height = fullscreen_height / 2;
+    }
 
     // Create an SDL Window
     window = SDL_CreateWindow(
@@ -92,19 +303,61 @@ bool initialize_window(void) {
         return false;
     }
     SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
-    
-    // Allocate memory (in bytes) to hold the color buffer
-    color_buffer = (uint32_t *) malloc(sizeof(uint32_t) * window_width * window_height);
-    z_buffer = (float *) malloc(sizeof(float) * window_width * window_height);
 
-    // Create an SDL texture to display the color buffer
+    // Create an SDL texture to display the color buffer. Colors and textures
+    // are ARGB throughout, the format SDL renderers usually prefer, so
+    // presenting needs no conversion.
     color_buffer_texture = SDL_CreateTexture(
         renderer,
-        SDL_PIXELFORMAT_RGBA32,
+        SDL_PIXELFORMAT_ARGB8888,
         SDL_TEXTUREACCESS_STREAMING,
         window_width,
         window_height
     );
+    if (!color_buffer_texture) {
+        fprintf(stderr, "Error creating SDL texture.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// No window or renderer, just the timer and (empty) event queue the main
+// loop relies on; frames stay in the color buffer
+static bool initialize_headless(void) {
+    if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0) {
+        fprintf(stderr, "Error initializing SDL.\n");
+        return false;
+    }
+
+    if (window_width <= 0 || window_height <= 0) {
+        fprintf(stderr, "Invalid headless resolution %dx%d.\n", window_width, window_height);
+        return false;
+    }
+
+    return true;
+}
+
+bool initialize_window(void) {
+    bool initialized = display_backend == DISPLAY_HEADLESS
+        ? initialize_headless()
+        : initialize_sdl_window();
+    if (!initialized) return false;
+
+    // Allocate memory (in bytes) to hold the color buffer
+    owned_color_buffer = (uint32_t *) malloc(sizeof(uint32_t) * window_width * window_height);
+    z_buffer = (float *) malloc(sizeof(float) * window_width * window_height);
+    if (!owned_color_buffer || !z_buffer) {
+        fprintf(stderr, "Error allocating the color and z-buffers.\n");
+        return false;
+    }
+    buffer_width = window_width;
+    buffer_height = window_height;
+    color_buffer = owned_color_buffer;
+    color_pitch = window_width;
+
+    // Headless there's no texture to draw into
+    if (display_backend == DISPLAY_HEADLESS) zero_copy = false;
 
     return true;
 }
@@ -112,7 +365,7 @@ bool initialize_window(void) {
 void draw_grid(int gridsize) {
     for (int y = 0; y < window_height; y += gridsize) {
         for (int x = 0; x < window_width; x += gridsize) {
-            color_buffer[window_width * y + x] = 0xFF999999;
+            color_buffer[color_pitch * y + x] = 0xFF999999;
         }
     }
 }
@@ -121,7 +374,7 @@ void draw_checker(int tilesize) {
     for (int y = 0; y < window_height / tilesize; y++) {
         for (int x = 0; x < window_width / tilesize; x++) {
             if (x % 2 == y % 2) {
-                draw_rect(x * tilesize, y * tilesize, tilesize, tilesize, 0xFF151515);
+                draw_rect(x * tilesize, y * tilesize, tilesize, tilesize, CHECKER_COLOR);
             }
         }
     }
@@ -130,29 +383,136 @@ void draw_checker(int tilesize) {
 void draw_pixel(int x, int y, uint32_t color) {
     if (x < 0 || x >= window_width || y < 0 || y >= window_height) return;
 
-    color_buffer[window_width * y + x] = color;
+    color_buffer[color_pitch * y + x] = color;
 }
 
-void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
+// Cohen-Sutherland outcodes: which sides of the window a point is beyond
+enum {
+    OUTSIDE_LEFT = 0x1,
+    OUTSIDE_RIGHT = 0x2,
+    OUTSIDE_TOP = 0x4,
+    OUTSIDE_BOTTOM = 0x8,
+};
+
+// A line endpoint, with 1/w for depth testing
+typedef struct {
+    float x, y, rw;
+} line_point_t;
+
+static int outcode(line_point_t p) {
+    int code = 0;
+    if (p.x < 0) code |= OUTSIDE_LEFT;
+    else if (p.x > window_width - 1) code |= OUTSIDE_RIGHT;
+    if (p.y < 0) code |= OUTSIDE_TOP;
+    else if (p.y > window_height - 1) code |= OUTSIDE_BOTTOM;
+    return code;
+}
 
-    int longest_side_length = abs(dx) >= abs(dy) ? abs(dx) : abs(dy);
+// Cut a segment down to the part within the window, moving its endpoints
+// along it (1/w included), or return false if it misses the window
+static bool clip_line(line_point_t *a, line_point_t *b) {
+    int code_a = outcode(*a);
+    int code_b = outcode(*b);
+    for (int pass = 0; ; pass += 1) {
+        if (!(code_a | code_b)) return true;  // both inside
+        if (code_a & code_b) return false;    // both beyond the same side
+
+        // Each endpoint needs at most two moves; anything still outside
+        // after that is rounding where the line passes a corner
+        if (pass == 4) {
+            a->x = fminf(fmaxf(a->x, 0), window_width - 1);
+            a->y = fminf(fmaxf(a->y, 0), window_height - 1);
+            b->x = fminf(fmaxf(b->x, 0), window_width - 1);
+            b->y = fminf(fmaxf(b->y, 0), window_height - 1);
+            return true;
+        }
 
-    // Increment for each step (at least one of these has a step of 1)
-    float x_inc = dx / (float)longest_side_length;
-    float y_inc = dy / (float)longest_side_length;
+        // Move an endpoint that's outside onto one side it's beyond, pinning
+        // only that side's coordinate against rounding; if it's beyond
+        // another too, the next pass moves it along the line again
+        line_point_t *p = code_a ? a : b;
+        int code = code_a ? code_a : code_b;
+        float t;
+        if (code & (OUTSIDE_LEFT | OUTSIDE_RIGHT)) {
+            float edge = code & OUTSIDE_LEFT ? 0 : window_width - 1;
+            t = (edge - a->x) / (b->x - a->x);
+        } else {
+            float edge = code & OUTSIDE_TOP ? 0 : window_height - 1;
+            t = (edge - a->y) / (b->y - a->y);
+        }
+        line_point_t clipped = {
+            a->x + (b->x - a->x) * t,
+            a->y + (b->y - a->y) * t,
+            a->rw + (b->rw - a->rw) * t,
+        };
+        if (code & OUTSIDE_LEFT) clipped.x = 0;
+        else if (code & OUTSIDE_RIGHT) clipped.x = window_width - 1;
+        else if (code & OUTSIDE_TOP) clipped.y = 0;
+        else clipped.y = window_height - 1;
+
+        *p = clipped;
+        if (p == a) {
+            code_a = outcode(*a);
+        } else {
+            code_b = outcode(*b);
+        }
+    }
+}
 
-    float current_x = x0;
-    float current_y = y0;
+// Bresenham's line algorithm over the clipped segment, writing the color
+// buffer directly; every pixel it steps to is inside the window. When depth
+// testing, 1/w is interpolated along the line and pixels behind the z-buffer
+// are skipped (without writing it: lines are an overlay).
+static void raster_line(line_point_t a, line_point_t b, uint32_t color, bool depth_test) {
+    if (!clip_line(&a, &b)) return;
+
+    int x0 = (int)(a.x + 0.5f), y0 = (int)(a.y + 0.5f);
+    int x1 = (int)(b.x + 0.5f), y1 = (int)(b.y + 0.5f);
+
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+
+    // Each step moves one pixel along the longer axis
+    int num_steps = dx > -dy ? dx : -dy;
+    float rw = a.rw;
+    float rw_step = num_steps > 0 ? (b.rw - a.rw) / num_steps : 0;
+
+    while (true) {
+        if (!depth_test || 1 - rw <= z_buffer[window_width * y0 + x0] + LINE_DEPTH_BIAS) {
+            color_buffer[color_pitch * y0 + x0] = color;
+        }
+        if (x0 == x1 && y0 == y1) break;
 
-    for (int i = 0; i <= longest_side_length; i++) {
-        draw_pixel(round(current_x), round(current_y), color);
-        current_x += x_inc;
-        current_y += y_inc;
+        int error2 = 2 * error;
+        if (error2 >= dy) {
+            error += dy;
+            x0 += step_x;
+        }
+        if (error2 <= dx) {
+            error += dx;
+            y0 += step_y;
+        }
+        rw += rw_step;
     }
 }
 
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color) {
+    line_point_t a = { x0, y0, 0 };
+    line_point_t b = { x1, y1, 0 };
+    raster_line(a, b, color, false);
+}
+
+// A line between two projected points, hidden where the z-buffer has
+// anything nearer than it
+void draw_line_depth(int x0, int y0, float w0, int x1, int y1, float w1, uint32_t color) {
+    line_point_t a = { x0, y0, 1 / w0 };
+    line_point_t b = { x1, y1, 1 / w1 };
+    raster_line(a, b, color, true);
+}
+
 void draw_rect(int posx, int posy, int width, int height, uint32_t color) {
     for (int y = posy; y < posy + height; y += 1) {
         for (int x = posx; x < posx + width; x += 1) {
@@ -167,35 +527,158 @@ void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t colo
     draw_line(x2, y2, x0, y0, color);
 }
 
-void render_color_buffer(void) {
-    SDL_UpdateTexture(
-        color_buffer_texture,
-        NULL,
-        color_buffer,
-        (int) window_width * sizeof (uint32_t)
-    );
-    SDL_RenderCopy(renderer, color_buffer_texture, NULL, NULL);
+void draw_triangle_depth(
+        int x0, int y0, float w0,
+        int x1, int y1, float w1,
+        int x2, int y2, float w2,
+        uint32_t color
+) {
+    draw_line_depth(x0, y0, w0, x1, y1, w1, color);
+    draw_line_depth(x1, y1, w1, x2, y2, w2, color);
+    draw_line_depth(x2, y2, w2, x0, y0, w0, color);
+}
+
+// Point the color buffer at where this frame gets drawn: into the streaming
+// texture itself when presenting zero-copy (falling back to copying if it
+// can't be locked), otherwise our own buffer. Locked texture memory starts
+// out undefined, which is fine as frames are cleared before drawing.
+void acquire_color_buffer(void) {
+    if (color_buffer_locked) return;
+
+    if (zero_copy && color_buffer_texture) {
+        SDL_Rect rect = { 0, 0, window_width, window_height };
+        void *pixels;
+        int pitch;
+        bool locked = SDL_LockTexture(color_buffer_texture, &rect, &pixels, &pitch) == 0;
+        if (locked && pitch % sizeof(uint32_t) == 0) {
+            color_buffer = pixels;
+            color_pitch = pitch / sizeof(uint32_t);
+            color_buffer_locked = true;
+            return;
+        }
+        if (locked) SDL_UnlockTexture(color_buffer_texture);
+        fprintf(stderr, "Error locking the color buffer texture, presenting by copying instead.\n");
+        zero_copy = false;
+    }
+
+    color_buffer = owned_color_buffer;
+    color_pitch = window_width;
+}
+
+// Only the part of the texture at the internal resolution is used, and the
+// renderer scales it up to the window
+static void present_sdl(void) {
+    SDL_Rect rect = { 0, 0, window_width, window_height };
+    if (color_buffer_locked) {
+        SDL_UnlockTexture(color_buffer_texture);
+        color_buffer_locked = false;
+    } else {
+        SDL_UpdateTexture(
+            color_buffer_texture,
+            &rect,
+            color_buffer,
+            (int) color_pitch * sizeof (uint32_t)
+        );
+    }
+    SDL_RenderCopy(renderer, color_buffer_texture, &rect, NULL);
     SDL_RenderPresent(renderer);
 }
 
-void render_z_buffer(void) {
-    // Place z-buffer values into color buffer as RGBA in order to
+static void present_headless(void) {
+    if (frame_dump_pattern[0] == '\0') return;
+
+    char filename[sizeof(frame_dump_pattern) + 16];
+    snprintf(filename, sizeof(filename), frame_dump_pattern, frame_number);
+    write_image(filename, color_buffer, window_width, window_height);
+}
+
+void render_color_buffer(void) {
+    if (display_backend == DISPLAY_HEADLESS) {
+        present_headless();
+    } else {
+        present_sdl();
+    }
+    frame_number += 1;
+}
+
+// The frame as drawn so far, window_width * window_height ARGB pixels. Rows
+// are contiguous except when presenting zero-copy, which headless never does.
+const uint32_t *get_color_buffer(void) {
+    return color_buffer;
+}
+
+// Row y of the frame being drawn, for the rasterizer to write whole spans
+// (unchecked: y must be within the window)
+uint32_t *get_color_buffer_row(int y) {
+    return &color_buffer[color_pitch * y];
+}
+
+// The z-buffer, window_width * window_height contiguous depths
+float *get_z_buffer(void) {
+    return z_buffer;
+}
+
+void draw_z_buffer(void) {
+    // Place z-buffer values into color buffer as ARGB in order to
     // visualize depth
     for (int y = 0; y < window_height; y++) {
         for (int x = 0; x < window_width; x++) {
             if (z_buffer[window_width * y + x] < 1.0) {
                 uint8_t c = 0xFF * (1 - z_buffer[window_width * y + x]);
-                color_buffer[window_width * y + x] = 0xFF000000 | (c << 16) | (c << 8) | c;
+                color_buffer[color_pitch * y + x] = 0xFF000000 | (c << 16) | (c << 8) | c;
             }
         }
     }
+}
+
+void clear_heatmap(void) {
+    memset(heatmap, 0, window_width * window_height);
+}
+
+// Called by the rasterizer for each depth tested pixel while the heatmap
+// view is on; counts saturate at 255
+void count_heatmap_at(int x, int y, bool written) {
+    if (x < 0 || x >= window_width || y < 0 || y >= window_height) return;
+    if (heatmap_mode == HEATMAP_OVERDRAW && !written) return;
+
+    uint8_t *count = &heatmap[window_width * y + x];
+    if (*count < 0xFF) *count += 1;
+}
+
+// Black for untouched pixels, then blue through red to white for 8 or more
+static const uint32_t heat_palette[] = {
+    0xFF000000, 0xFF1830A0, 0xFF2070F0, 0xFF20C0C0, 0xFF30C030,
+    0xFFE0E020, 0xFFF08020, 0xFFE02020, 0xFFFFFFFF,
+};
+#define HEAT_PALETTE_SIZE (int)(sizeof(heat_palette) / sizeof(heat_palette[0]))
+
+// Replace the color buffer with the heatmap counts, plus a legend of the
+// palette in the bottom left corner
+void draw_heatmap(void) {
+    for (int y = 0; y < window_height; y += 1) {
+        for (int x = 0; x < window_width; x += 1) {
+            int count = heatmap[window_width * y + x];
+            if (count >= HEAT_PALETTE_SIZE) count = HEAT_PALETTE_SIZE - 1;
+            color_buffer[color_pitch * y + x] = heat_palette[count];
+        }
+    }
 
-    render_color_buffer();
+    int size = FONT_LINE_HEIGHT + 2;
+    int x = 4;
+    int y = window_height - 4 - size;
+    for (int count = 0; count < HEAT_PALETTE_SIZE; count += 1) {
+        char label[4];
+        snprintf(label, sizeof(label), count == HEAT_PALETTE_SIZE - 1 ? "%d+" : "%d", count);
+        draw_rect(x, y, 2 * size, size, heat_palette[count]);
+        draw_text(x + 2, y + 2, label, count >= 4 && count != 7 ? 0xFF000000 : 0xFFFFFFFF);
+        x += 2 * size;
+    }
 }
 
 void clear_color_buffer(uint32_t color) {
-    for (int i = 0; i < window_width * window_height; i += 1)
-        color_buffer[i] = color;
+    for (int y = 0; y < window_height; y += 1)
+        for (int x = 0; x < window_width; x += 1)
+            color_buffer[color_pitch * y + x] = color;
 }
 
 void clear_z_buffer(void) {
@@ -203,20 +686,125 @@ void clear_z_buffer(void) {
         z_buffer[i] = 1.0;
 }
 
-float get_z_buffer_at(int x, int y) {
-    if (x < 0 || x >= window_width || y < 0 || y >= window_height) return 1.0;
-    return z_buffer[window_width * y + x];
+// The same pattern draw_checker draws over a clear_color_buffer: only whole
+// tiles, so the right and bottom edges may be left in the clear color
+static void draw_background(uint32_t color, int tilesize) {
+    int tiles_x = window_width / tilesize;
+    int tiles_y = window_height / tilesize;
+    for (int y = 0; y < window_height; y += 1) {
+        int tile_y = y / tilesize;
+        for (int x = 0; x < window_width; x += 1) {
+            int tile_x = x / tilesize;
+            bool tile = tile_x < tiles_x && tile_y < tiles_y && tile_x % 2 == tile_y % 2;
+            background[window_width * y + x] = tile ? CHECKER_COLOR : color;
+        }
+    }
+
+    background_width = window_width;
+    background_height = window_height;
+    background_color = color;
+    background_tilesize = tilesize;
 }
 
-void update_z_buffer_at(int x, int y, float value) {
-    if (x < 0 || x >= window_width || y < 0 || y >= window_height) return;
-    z_buffer[window_width * y + x] = value;
+// Copy a row without pulling the destination into the cache: the frame is
+// bigger than the cache, so by the time the rasterizer gets to a row it'd
+// have been evicted anyway, after costing a read to fill it. Elsewhere
+// there are no streaming stores to use, so it's a plain (wide) memcpy.
+static void stream_row(uint32_t *dst, const uint32_t *src, int count) {
+#ifdef DISPLAY_SSE2
+    int x = 0;
+    for (; x < count && ((uintptr_t)(dst + x) & 15); x += 1) dst[x] = src[x];
+    for (; x + 4 <= count; x += 4) {
+        _mm_stream_si128((__m128i *)(dst + x), _mm_loadu_si128((const __m128i *)(src + x)));
+    }
+    for (; x < count; x += 1) dst[x] = src[x];
+#else
+    memcpy(dst, src, sizeof(uint32_t) * count);
+#endif
+}
+
+// Fill a row of depths, streaming with SSE2 and with 4-wide stores on NEON
+static void stream_fill_depth(float *dst, float value, int count) {
+    int x = 0;
+#if defined(DISPLAY_SSE2)
+    for (; x < count && ((uintptr_t)(dst + x) & 15); x += 1) dst[x] = value;
+    __m128 values = _mm_set1_ps(value);
+    for (; x + 4 <= count; x += 4) {
+        _mm_stream_ps(dst + x, values);
+    }
+#elif defined(DISPLAY_NEON)
+    float32x4_t values = vdupq_n_f32(value);
+    for (; x + 16 <= count; x += 16) {
+        vst1q_f32(dst + x, values);
+        vst1q_f32(dst + x + 4, values);
+        vst1q_f32(dst + x + 8, values);
+        vst1q_f32(dst + x + 12, values);
+    }
+    for (; x + 4 <= count; x += 4) {
+        vst1q_f32(dst + x, values);
+    }
+#endif
+    for (; x < count; x += 1) dst[x] = value;
+}
+
+// Clear a band of rows of the color (to the background) and z-buffers in
+// one pass (a job_fn; arg is the band's first row)
+static void clear_band(void *arg) {
+    int y0 = (int)(intptr_t)arg;
+    int y1 = y0 + CLEAR_BAND_HEIGHT < window_height ? y0 + CLEAR_BAND_HEIGHT : window_height;
+    for (int y = y0; y < y1; y += 1) {
+        stream_row(&color_buffer[color_pitch * y], &background[window_width * y], window_width);
+        stream_fill_depth(&z_buffer[window_width * y], 1.0, window_width);
+    }
+#ifdef DISPLAY_SSE2
+    // Streaming stores aren't ordered with others, so finish them before
+    // anyone draws over them
+    _mm_sfence();
+#endif
+}
+
+// Equivalent to clear_color_buffer(color), draw_checker(tilesize) and
+// clear_z_buffer(), in a single parallel pass
+void clear_frame_to_checker(uint32_t color, int tilesize) {
+    if (!background) {
+        background = malloc(sizeof(uint32_t) * buffer_width * buffer_height);
+        if (!background) {
+            fprintf(stderr, "Error allocating the background.\n");
+            clear_color_buffer(color);
+            draw_checker(tilesize);
+            clear_z_buffer();
+            return;
+        }
+    }
+    bool stale = background_width != window_width
+        || background_height != window_height
+        || background_color != color
+        || background_tilesize != tilesize;
+    if (stale) draw_background(color, tilesize);
+
+    // Without workers (e.g. before init_jobs), clear here
+    if (get_num_workers() == 0) {
+        for (int y = 0; y < window_height; y += CLEAR_BAND_HEIGHT) {
+            clear_band((void *)(intptr_t)y);
+        }
+        return;
+    }
+
+    job_group_t group = { 0 };
+    for (int y = 0; y < window_height; y += CLEAR_BAND_HEIGHT) {
+        submit_job(&group, clear_band, (void *)(intptr_t)y);
+    }
+    wait_job_group(&group);
 }
 
 void destroy_window(void) {
-    free(color_buffer);
+    if (color_buffer_locked) SDL_UnlockTexture(color_buffer_texture);
+    free(owned_color_buffer);
     free(z_buffer);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    free(heatmap);
+    free(background);
+    if (color_buffer_texture) SDL_DestroyTexture(color_buffer_texture);
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (window) SDL_DestroyWindow(window);
     SDL_Quit();
 }
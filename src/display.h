@@ -18,6 +18,33 @@ enum render_mode {
     MODE_TEXTUREWIRE = MODE_TEXTURE | MODE_WIRE,
 }; // display_mode;
 
+// Where frames go: an SDL window, or nowhere but the color buffer (and
+// optionally image files) for hosts without a display or GPU
+enum display_backend {
+    DISPLAY_SDL,
+    DISPLAY_HEADLESS,
+};
+
+// What the heatmap view counts for each pixel over a frame
+enum heatmap_mode {
+    HEATMAP_OFF,
+    HEATMAP_OVERDRAW,           // writes, i.e. depth test passes
+    HEATMAP_DEPTH_COMPLEXITY,   // depth tests, passed or not
+};
+
+// How textures are mapped across a triangle's spans
+enum texture_mapping {
+    TEXTURE_PERSPECTIVE,    // exact, with a divide per pixel
+    TEXTURE_SUBDIVIDED,     // exact every few pixels, affine in between
+    TEXTURE_AFFINE,         // linear in screen space, warping at an angle
+};
+
+// How filled (untextured) triangles are lit
+enum shading {
+    SHADING_FLAT,       // one intensity per face, from its normal
+    SHADING_GOURAUD,    // per vertex, from vertex normals, interpolated
+};
+
 // I _could_ pull this into the enum, but since the presented options
 // are intended to be mutually exclusive it leads to a bunch of cases
 // which are awkward to toggle.
@@ -42,17 +69,56 @@ void toggle_cull_backfaces(void);
 bool get_show_depth(void);
 void set_show_depth(bool setting);
 void toggle_show_depth(void);
+bool get_depth_test(void);
+void set_depth_test(bool setting);
+void toggle_depth_test(void);
+int get_texture_mapping(void);
+void set_texture_mapping(int mapping);
+void cycle_texture_mapping(void);
+int get_texture_subdivision(void);
+void set_texture_subdivision(int pixels);
+int get_shading(void);
+void set_shading(int setting);
+void cycle_shading(void);
+bool get_wire_depth_test(void);
+void set_wire_depth_test(bool setting);
+void toggle_wire_depth_test(void);
+int get_heatmap_mode(void);
+void set_heatmap_mode(int mode);
+void cycle_heatmap_mode(void);
+int get_display_backend(void);
+void set_display_backend(int backend);
+void set_internal_resolution(int width, int height);
+int get_max_render_width(void);
+int get_max_render_height(void);
+void set_render_resolution(int width, int height);
+bool set_frame_dump(char *pattern);
+bool get_zero_copy(void);
+void set_zero_copy(bool setting);
 bool initialize_window(void);
 void draw_grid(int gridsize);
 void draw_checker(int tilesize);
 void draw_pixel(int x, int y, uint32_t color);
 void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+void draw_line_depth(int x0, int y0, float w0, int x1, int y1, float w1, uint32_t color);
 void draw_rect(int posx, int posy, int width, int height, uint32_t color);
 void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+void draw_triangle_depth(
+        int x0, int y0, float w0,
+        int x1, int y1, float w1,
+        int x2, int y2, float w2,
+        uint32_t color
+);
+void acquire_color_buffer(void);
 void render_color_buffer(void);
-void render_z_buffer(void);
+const uint32_t *get_color_buffer(void);
+uint32_t *get_color_buffer_row(int y);
+float *get_z_buffer(void);
+void draw_z_buffer(void);
+void clear_heatmap(void);
+void count_heatmap_at(int x, int y, bool written);
+void draw_heatmap(void);
 void clear_color_buffer(uint32_t color);
 void clear_z_buffer(void);
-float get_z_buffer_at(int x, int y);
-void update_z_buffer_at(int x, int y, float value);
+void clear_frame_to_checker(uint32_t color, int tilesize);
 void destroy_window(void);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// Built-in bitmap font for on-screen text
+#define FONT_GLYPH_WIDTH 5
+#define FONT_GLYPH_HEIGHT 7
+#define FONT_ADVANCE 6       // glyph width plus spacing
+#define FONT_LINE_HEIGHT 9   // glyph height plus spacing
+
+int draw_text(int x, int y, const char *text, uint32_t color);
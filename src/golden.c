@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "golden.h"
+#include "display.h"
+#include "image.h"
+#include "texture.h"
+
+static int channel_difference(uint32_t a, uint32_t b, int shift) {
+    return abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+}
+
+static bool pixels_match(uint32_t a, uint32_t b) {
+    return channel_difference(a, b, 16) <= GOLDEN_TOLERANCE &&
+        channel_difference(a, b, 8) <= GOLDEN_TOLERANCE &&
+        channel_difference(a, b, 0) <= GOLDEN_TOLERANCE;
+}
+
+// Differing pixels in red, the rest a dimmed gray version of the frame
+static void write_diff_image(const char *filename, const uint32_t *actual, const uint32_t *expected, int width, int height) {
+    uint32_t *diff = malloc(sizeof(uint32_t) * width * height);
+    if (!diff) return;
+
+    for (int i = 0; i < width * height; i += 1) {
+        if (pixels_match(actual[i], expected[i])) {
+            uint32_t c = actual[i];
+            uint32_t gray = (((c >> 16) & 0xFF) + ((c >> 8) & 0xFF) + (c & 0xFF)) / 12;
+            diff[i] = 0xFF000000 | (gray << 16) | (gray << 8) | gray;
+        } else {
+            diff[i] = 0xFFFF0000;
+        }
+    }
+    write_image(filename, diff, width, height);
+    free(diff);
+}
+
+bool check_golden_image(const char *dir, const char *name) {
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/%s.png", dir, name);
+
+    int width = get_window_width();
+    int height = get_window_height();
+    const uint32_t *actual = get_color_buffer();
+
+    texture_t *expected = load_png_texture(filename);
+    int num_differing = 0;
+    bool passed = false;
+    if (!expected) {
+        fprintf(stderr, "FAIL %s: no reference image %s\n", name, filename);
+    } else if (expected->width != width || expected->height != height) {
+        fprintf(stderr, "FAIL %s: reference is %dx%d, frame is %dx%d\n",
+            name, expected->width, expected->height, width, height);
+    } else {
+        for (int i = 0; i < width * height; i += 1) {
+            num_differing += !pixels_match(actual[i], expected->texels[i]);
+        }
+        passed = num_differing <= GOLDEN_MAX_DIFFERING * width * height;
+        printf("%s %s: %d of %d pixels differ\n", passed ? "ok  " : "FAIL", name, num_differing, width * height);
+    }
+
+    if (!passed) {
+        snprintf(filename, sizeof(filename), "%s/%s-actual.png", dir, name);
+        write_image(filename, actual, width, height);
+        if (expected && expected->width == width && expected->height == height) {
+            snprintf(filename, sizeof(filename), "%s/%s-diff.png", dir, name);
+            write_diff_image(filename, actual, expected->texels, width, height);
+        }
+    }
+
+    free_texture(expected);
+    return passed;
+}
+
+// Replace the reference image with the current frame
+bool update_golden_image(const char *dir, const char *name) {
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/%s.png", dir, name);
+    bool ok = write_image(filename, get_color_buffer(), get_window_width(), get_window_height());
+    printf("%s %s\n", ok ? "wrote" : "FAILED to write", filename);
+    return ok;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Golden image checks
+//
+// Compares the color buffer with a reference image <dir>/<name>.png. A pixel
+// differs when any channel is off by more than GOLDEN_TOLERANCE, and the
+// check fails when more than GOLDEN_MAX_DIFFERING of the pixels differ (so
+// an edge shifting by a pixel under another compiler's float rounding
+// doesn't fail it). On failure the frame and a diff image, with differing
+// pixels in red over a dimmed frame, are written next to the reference as
+// <name>-actual.png and <name>-diff.png.
+
+#define GOLDEN_TOLERANCE 16
+#define GOLDEN_MAX_DIFFERING 0.001
+
+bool check_golden_image(const char *dir, const char *name);
+bool update_golden_image(const char *dir, const char *name);
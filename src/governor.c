@@ -0,0 +1,69 @@
+#include <math.h>
+
+#include "governor.h"
+#include "display.h"
+
+// Weight of each new frame time in the running average
+#define GOVERNOR_SMOOTHING 0.1
+// Frames between changes, enough for the average to reflect the last one
+#define GOVERNOR_INTERVAL 16
+// Aim below the budget, as frame times vary more than the average shows
+#define GOVERNOR_HEADROOM 0.85
+// Frame times within this fraction of the aim are left alone
+#define GOVERNOR_DEADBAND 0.1
+// Largest changes of the scale at once; drop quicker than recovering
+#define GOVERNOR_MAX_DROP 0.75
+#define GOVERNOR_MAX_RISE 1.1
+
+static bool governing = false;
+static float min_scale = 1.0;
+static float max_scale = 1.0;
+
+static double average_ms = 0;
+static int frames_since_change = 0;
+
+bool get_governing(void) {
+    return governing;
+}
+
+// Start governing the scale within [min, max] (in (0, 1]), or stop with
+// min == max
+void set_governor_bounds(float min, float max) {
+    min_scale = min;
+    max_scale = max;
+    governing = min < max;
+    average_ms = 0;
+    frames_since_change = 0;
+}
+
+// Take the time spent on the last frame (not waiting for the next) and
+// return the scale to draw the next one at
+float update_governor(float scale, double frame_ms) {
+    if (!governing) return scale;
+
+    average_ms = average_ms > 0
+        ? average_ms + GOVERNOR_SMOOTHING * (frame_ms - average_ms)
+        : frame_ms;
+    frames_since_change += 1;
+    if (frames_since_change < GOVERNOR_INTERVAL || average_ms <= 0) return scale;
+
+    double target_ms = FRAME_TARGET_TIME * GOVERNOR_HEADROOM;
+    double ratio = target_ms / average_ms;
+    if (fabs(ratio - 1) < GOVERNOR_DEADBAND) return scale;
+
+    // Raster work grows with the pixel count, the square of the scale, and
+    // dominates heavy frames
+    double factor = sqrt(ratio);
+    if (factor < GOVERNOR_MAX_DROP) factor = GOVERNOR_MAX_DROP;
+    if (factor > GOVERNOR_MAX_RISE) factor = GOVERNOR_MAX_RISE;
+
+    float next = scale * factor;
+    if (next < min_scale) next = min_scale;
+    if (next > max_scale) next = max_scale;
+    if (next == scale) return scale;
+
+    // Measure the new scale afresh
+    average_ms = 0;
+    frames_since_change = 0;
+    return next;
+}
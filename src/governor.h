@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Dynamic resolution governor
+//
+// Picks the internal resolution's scale (relative to the largest one) from
+// measured frame times, to hold frames within FRAME_TARGET_TIME on heavy
+// scenes and win the resolution back once they're light again. Changes are
+// spaced out and skip small errors, so the scale doesn't oscillate.
+
+bool get_governing(void);
+void set_governor_bounds(float min_scale, float max_scale);
+float update_governor(float scale, double frame_ms);
@@ -0,0 +1,103 @@
+#include <stdio.h>
+
+#include "hud.h"
+#include "display.h"
+#include "font.h"
+#include "profile.h"
+#include "stats.h"
+
+#define HUD_X 4
+#define HUD_Y 4
+#define HUD_PADDING 4
+#define HUD_WIDTH (2 * HUD_PADDING + PROFILE_HISTORY * 2)
+#define GRAPH_HEIGHT 48
+#define GRAPH_MAX_MS (2 * 1000.0 / FPS)
+
+static bool show_hud = false;
+
+bool get_show_hud(void) {
+    return show_hud;
+}
+
+void set_show_hud(bool setting) {
+    show_hud = setting;
+}
+
+void toggle_show_hud(void) {
+    show_hud = !show_hud;
+}
+
+// Bars of the recent frame times, oldest on the left, against a line at the
+// frame budget
+static void draw_frame_graph(int x, int y) {
+    int length = get_profile_history_length();
+    for (int age = 0; age < length; age += 1) {
+        double ms = get_profile_history(age)->frame_ms;
+        uint32_t color = ms <= 1000.0 / FPS ? 0xFF40C040 : ms <= GRAPH_MAX_MS ? 0xFFE0C040 : 0xFFE04040;
+        if (ms > GRAPH_MAX_MS) ms = GRAPH_MAX_MS;
+
+        int height = ms / GRAPH_MAX_MS * GRAPH_HEIGHT;
+        int column = x + (PROFILE_HISTORY - 1 - age) * 2;
+        draw_rect(column, y + GRAPH_HEIGHT - height, 2, height, color);
+    }
+
+    draw_line(x, y + GRAPH_HEIGHT / 2, x + PROFILE_HISTORY * 2 - 1, y + GRAPH_HEIGHT / 2, 0xFF808080);
+}
+
+void draw_hud(void) {
+    if (!show_hud) return;
+
+    // Average over the whole history so the numbers are readable
+    int length = get_profile_history_length();
+    double frame_ms = 0;
+    double interval_ms = 0;
+    double stage_ms[NUM_PROFILE_STAGES] = { 0 };
+    for (int age = 0; age < length; age += 1) {
+        const profile_frame_t *frame = get_profile_history(age);
+        frame_ms += frame->frame_ms / length;
+        interval_ms += frame->interval_ms / length;
+        for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+            stage_ms[i] += frame->stage_ms[i] / length;
+        }
+    }
+    // Counters of the last complete frame
+    pipeline_stats_t stats = get_frame_stats();
+
+    int num_lines = 4 + NUM_PROFILE_STAGES;
+    int height = 2 * HUD_PADDING + num_lines * FONT_LINE_HEIGHT + HUD_PADDING + GRAPH_HEIGHT;
+    draw_rect(HUD_X, HUD_Y, HUD_WIDTH, height, 0xFF101010);
+
+    int x = HUD_X + HUD_PADDING;
+    int y = HUD_Y + HUD_PADDING;
+    char line[64];
+
+    snprintf(line, sizeof(line), "fps %.1f  frame %.2f ms  %dx%d", interval_ms > 0 ? 1000 / interval_ms : 0, frame_ms,
+        get_window_width(), get_window_height());
+    draw_text(x, y, line, 0xFFFFFFFF);
+    y += FONT_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "faces %llu  culled %llu  clipped %llu  out %llu",
+        (unsigned long long)stats.faces_in, (unsigned long long)stats.faces_culled,
+        (unsigned long long)stats.faces_clipped, (unsigned long long)stats.faces_rejected);
+    draw_text(x, y, line, 0xFFFFFFFF);
+    y += FONT_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "triangles %llu  pixels %llu",
+        (unsigned long long)stats.triangles_emitted, (unsigned long long)stats.pixels_covered);
+    draw_text(x, y, line, 0xFFFFFFFF);
+    y += FONT_LINE_HEIGHT;
+    snprintf(line, sizeof(line), "depth pass %llu  fail %llu  texels %llu",
+        (unsigned long long)stats.depth_passed, (unsigned long long)stats.depth_failed,
+        (unsigned long long)stats.texels_fetched);
+    draw_text(x, y, line, 0xFFFFFFFF);
+    y += FONT_LINE_HEIGHT;
+
+    for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+        // Indent the parts of update
+        bool part_of_update = i >= STAGE_TRANSFORM && i <= STAGE_PROJECT;
+        snprintf(line, sizeof(line), "%s%-*s%6.2f ms", part_of_update ? "  " : "",
+            part_of_update ? 12 : 14, get_profile_stage_name(i), stage_ms[i]);
+        draw_text(x, y, line, 0xFFC0C0C0);
+        y += FONT_LINE_HEIGHT;
+    }
+
+    draw_frame_graph(x, y + HUD_PADDING);
+}
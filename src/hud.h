@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdbool.h>
+
+// On-screen debug overlay showing the profiler's stage times, frame rate,
+// a frame time graph and triangle counts
+bool get_show_hud(void);
+void set_show_hud(bool setting);
+void toggle_show_hud(void);
+void draw_hud(void);
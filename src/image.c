@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+
+// Binary PPM (P6), the simplest format most image tools can read
+bool write_ppm(const char *filename, const uint32_t *pixels, int width, int height) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return false;
+    }
+
+    unsigned char *row = malloc(width * 3);
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y += 1) {
+        for (int x = 0; x < width; x += 1) {
+            uint32_t color = pixels[width * y + x];
+            row[x * 3 + 0] = color >> 16;
+            row[x * 3 + 1] = color >> 8;
+            row[x * 3 + 2] = color;
+        }
+        fwrite(row, 1, width * 3, file);
+    }
+    free(row);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *data, unsigned long size) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i += 1) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k += 1) {
+                c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+            }
+            table[i] = c;
+        }
+    }
+
+    for (unsigned long i = 0; i < size; i += 1) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_u32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static void write_chunk(FILE *file, const char *type, const unsigned char *data, unsigned long size) {
+    unsigned char header[8];
+    put_u32(header, size);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, 8, file);
+    fwrite(data, 1, size, file);
+
+    unsigned char crc[4];
+    put_u32(crc, ~crc32_update(crc32_update(~0u, header + 4, 4), data, size));
+    fwrite(crc, 1, 4, file);
+}
+
+// RGB8 PNG. The image data is stored uncompressed (deflate "stored"
+// blocks), trading file size for not needing a compressor.
+bool write_png(const char *filename, const uint32_t *pixels, int width, int height) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return false;
+    }
+
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, file);
+
+    unsigned char ihdr[13];
+    put_u32(ihdr, width);
+    put_u32(ihdr + 4, height);
+    ihdr[8] = 8;    // bit depth
+    ihdr[9] = 2;    // RGB
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // adaptive filtering
+    ihdr[12] = 0;   // no interlacing
+    write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    // Scanlines with filter type 0 (none)
+    unsigned long stride = 1 + (unsigned long)width * 3;
+    unsigned long raw_size = stride * height;
+    unsigned char *raw = malloc(raw_size);
+    for (int y = 0; y < height; y += 1) {
+        unsigned char *row = raw + stride * y;
+        row[0] = 0;
+        for (int x = 0; x < width; x += 1) {
+            uint32_t color = pixels[width * y + x];
+            row[1 + x * 3 + 0] = color >> 16;
+            row[1 + x * 3 + 1] = color >> 8;
+            row[1 + x * 3 + 2] = color;
+        }
+    }
+
+    // zlib stream: header, stored blocks of up to 65535 bytes, Adler-32
+    unsigned long num_blocks = raw_size / 65535 + 1;
+    unsigned long zlib_size = 2 + num_blocks * 5 + raw_size + 4;
+    unsigned char *zlib = malloc(zlib_size);
+    unsigned char *p = zlib;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for (unsigned long offset = 0, i = 0; i < num_blocks; i += 1) {
+        unsigned long size = raw_size - offset < 65535 ? raw_size - offset : 65535;
+        *p++ = i == num_blocks - 1;
+        *p++ = size & 0xFF;
+        *p++ = size >> 8;
+        *p++ = ~size & 0xFF;
+        *p++ = (~size >> 8) & 0xFF;
+        memcpy(p, raw + offset, size);
+        p += size;
+        offset += size;
+    }
+    // (5552 is the most bytes that can be summed before b could overflow)
+    uint32_t a = 1, b = 0;
+    for (unsigned long offset = 0; offset < raw_size; offset += 5552) {
+        unsigned long end = raw_size - offset < 5552 ? raw_size : offset + 5552;
+        for (unsigned long i = offset; i < end; i += 1) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    put_u32(p, (b << 16) | a);
+
+    write_chunk(file, "IDAT", zlib, zlib_size);
+    write_chunk(file, "IEND", NULL, 0);
+    free(zlib);
+    free(raw);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+// Pick the format from the file extension (PPM unless it's .png)
+bool write_image(const char *filename, const uint32_t *pixels, int width, int height) {
+    const char *extension = strrchr(filename, '.');
+    if (extension && strcmp(extension, ".png") == 0) {
+        return write_png(filename, pixels, width, height);
+    }
+    return write_ppm(filename, pixels, width, height);
+}
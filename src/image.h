@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Writers for ARGB pixel buffers (like the color buffer), dropping alpha
+bool write_ppm(const char *filename, const uint32_t *pixels, int width, int height);
+bool write_png(const char *filename, const uint32_t *pixels, int width, int height);
+bool write_image(const char *filename, const uint32_t *pixels, int width, int height);
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "jobs.h"
+#include "trace.h"
+
+#define MAX_QUEUED_JOBS 256
+
+typedef struct {
+    job_fn fn;
+    void *arg;
+    job_group_t *group;
+} job_t;
+
+static SDL_Thread *workers[MAX_WORKERS];
+static int num_workers = 0;
+
+// Holds each worker's thread index; the main thread never sets it
+static SDL_TLSID thread_index = 0;
+
+// Ring buffer of queued jobs, guarded by queue_mutex
+static job_t queue[MAX_QUEUED_JOBS];
+static int queue_head = 0;
+static int queue_count = 0;
+static bool quitting = false;
+static SDL_mutex *queue_mutex = NULL;
+static SDL_cond *job_queued = NULL;
+static SDL_cond *job_finished = NULL;
+
+static void run_job(job_t job) {
+    TRACE_BEGIN("job");
+    job.fn(job.arg);
+    TRACE_END("job");
+
+    SDL_LockMutex(queue_mutex);
+    SDL_AtomicAdd(&job.group->pending, -1);
+    SDL_CondBroadcast(job_finished);
+    SDL_UnlockMutex(queue_mutex);
+}
+
+// Must be called with queue_mutex held
+static bool pop_job(job_t *job) {
+    if (queue_count == 0) return false;
+
+    *job = queue[queue_head];
+    queue_head = (queue_head + 1) % MAX_QUEUED_JOBS;
+    queue_count -= 1;
+    return true;
+}
+
+// Take the oldest queued job of the group out of the queue, wherever it is.
+// Must be called with queue_mutex held.
+static bool pop_group_job(job_group_t *group, job_t *job) {
+    for (int i = 0; i < queue_count; i += 1) {
+        int index = (queue_head + i) % MAX_QUEUED_JOBS;
+        if (queue[index].group != group) continue;
+
+        *job = queue[index];
+        for (int j = i + 1; j < queue_count; j += 1) {
+            int next = (queue_head + j) % MAX_QUEUED_JOBS;
+            queue[index] = queue[next];
+            index = next;
+        }
+        queue_count -= 1;
+        return true;
+    }
+    return false;
+}
+
+static int worker_main(void *data) {
+    SDL_TLSSet(thread_index, data, NULL);
+
+    SDL_LockMutex(queue_mutex);
+    while (!quitting) {
+        job_t job;
+        if (pop_job(&job)) {
+            SDL_UnlockMutex(queue_mutex);
+            run_job(job);
+            SDL_LockMutex(queue_mutex);
+        } else {
+            SDL_CondWait(job_queued, queue_mutex);
+        }
+    }
+    SDL_UnlockMutex(queue_mutex);
+
+    return 0;
+}
+
+// Start the worker threads; with num_workers <= 0, use one per core not
+// taken by the main thread (but at least one, so jobs still run async)
+bool init_jobs(int count) {
+    if (count <= 0) count = SDL_GetCPUCount() - 1;
+    if (count < 1) count = 1;
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+
+    queue_mutex = SDL_CreateMutex();
+    job_queued = SDL_CreateCond();
+    job_finished = SDL_CreateCond();
+    if (!queue_mutex || !job_queued || !job_finished) {
+        fprintf(stderr, "Error creating job queue.\n");
+        return false;
+    }
+
+    thread_index = SDL_TLSCreate();
+
+    quitting = false;
+    for (int i = 0; i < count; i += 1) {
+        void *index = (void *)(intptr_t)(num_workers + 1);
+        workers[num_workers] = SDL_CreateThread(worker_main, "worker", index);
+        if (!workers[num_workers]) {
+            fprintf(stderr, "Error creating worker thread.\n");
+            break;
+        }
+        num_workers += 1;
+    }
+
+    return num_workers > 0;
+}
+
+int get_num_workers(void) {
+    return num_workers;
+}
+
+// 0 on the main thread, 1 to get_num_workers() on the workers, for indexing
+// per-thread data
+int get_thread_index(void) {
+    if (thread_index == 0) return 0;
+    return (int)(intptr_t)SDL_TLSGet(thread_index);
+}
+
+void submit_job(job_group_t *group, job_fn fn, void *arg) {
+    job_t job = { fn, arg, group };
+    SDL_AtomicAdd(&group->pending, 1);
+
+    SDL_LockMutex(queue_mutex);
+    if (num_workers == 0 || queue_count == MAX_QUEUED_JOBS) {
+        // No room (or no one) to run it later, so run it now
+        SDL_UnlockMutex(queue_mutex);
+        run_job(job);
+        return;
+    }
+    queue[(queue_head + queue_count) % MAX_QUEUED_JOBS] = job;
+    queue_count += 1;
+    SDL_CondSignal(job_queued);
+    SDL_UnlockMutex(queue_mutex);
+}
+
+bool is_job_group_done(job_group_t *group) {
+    return SDL_AtomicGet(&group->pending) == 0;
+}
+
+// Block until every job in the group has finished, helping with its queued
+// jobs in the meantime rather than sitting idle. Jobs of other groups are
+// left to the workers, so a wait can't end up running a long job that was
+// meant to overlap it (like the next frame's build).
+void wait_job_group(job_group_t *group) {
+    SDL_LockMutex(queue_mutex);
+    while (SDL_AtomicGet(&group->pending) > 0) {
+        job_t job;
+        if (pop_group_job(group, &job)) {
+            SDL_UnlockMutex(queue_mutex);
+            run_job(job);
+            SDL_LockMutex(queue_mutex);
+        } else {
+            SDL_CondWait(job_finished, queue_mutex);
+        }
+    }
+    SDL_UnlockMutex(queue_mutex);
+}
+
+// Stop the workers once the jobs already queued are done
+void free_jobs(void) {
+    SDL_LockMutex(queue_mutex);
+    while (queue_count > 0) {
+        job_t job;
+        pop_job(&job);
+        SDL_UnlockMutex(queue_mutex);
+        run_job(job);
+        SDL_LockMutex(queue_mutex);
+    }
+    quitting = true;
+    SDL_CondBroadcast(job_queued);
+    SDL_UnlockMutex(queue_mutex);
+
+    for (int i = 0; i < num_workers; i += 1) {
+        SDL_WaitThread(workers[i], NULL);
+    }
+    num_workers = 0;
+
+    SDL_DestroyCond(job_finished);
+    SDL_DestroyCond(job_queued);
+    SDL_DestroyMutex(queue_mutex);
+}
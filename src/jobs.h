@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+// A pool of worker threads running jobs from a shared queue. Jobs are
+// submitted as part of a group, which can be polled or waited on.
+typedef void (*job_fn)(void *arg);
+
+// Upper bound on get_thread_index(), counting the main thread
+#define MAX_WORKERS 16
+#define MAX_THREADS (MAX_WORKERS + 1)
+
+typedef struct {
+    SDL_atomic_t pending; // jobs submitted but not finished yet
+} job_group_t;
+
+bool init_jobs(int num_workers);
+int get_num_workers(void);
+int get_thread_index(void);
+void submit_job(job_group_t *group, job_fn fn, void *arg);
+bool is_job_group_done(job_group_t *group);
+void wait_job_group(job_group_t *group);
+void free_jobs(void);
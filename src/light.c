@@ -1,4 +1,13 @@
 #include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LIGHT_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LIGHT_NEON
+#endif
+
 #include "vector.h"
 #include "light.h"
 
@@ -12,16 +21,89 @@ vec3_t get_light_direction(void) {
     return light.direction;
 }
 
-uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor) {
-    if (percentage_factor < 0) percentage_factor = 0;
+// An intensity from 0 to 1 (clamped) in fixed point
+uint16_t light_intensity_fixed(float percentage_factor) {
+    // (Negated, so a NaN from a degenerate normal is black too)
+    if (!(percentage_factor >= 0)) percentage_factor = 0;
     if (percentage_factor > 1) percentage_factor = 1;
+    return (uint16_t)(percentage_factor * LIGHT_ONE + 0.5f);
+}
 
-    uint32_t a = (original_color & 0xFF000000);
-    uint32_t r = (original_color & 0x00FF0000) * percentage_factor;
-    uint32_t g = (original_color & 0x0000FF00) * percentage_factor;
-    uint32_t b = (original_color & 0x000000FF) * percentage_factor;
+// Scale a color's red, green and blue by an intensity of at most LIGHT_ONE,
+// keeping its alpha. Red and blue are 16 bits apart, so one multiply scales
+// both without either spilling into the other.
+uint32_t light_modulate(uint32_t color, uint16_t intensity) {
+    uint32_t a = color & 0xFF000000;
+    uint32_t rb = (((color & 0x00FF00FF) * intensity) >> 8) & 0x00FF00FF;
+    uint32_t g = (((color & 0x0000FF00) * intensity) >> 8) & 0x0000FF00;
+    return a | rb | g;
+}
 
-    uint32_t new_color = a | (r & 0x00FF0000) | (g & 0x0000FF00) | (b & 0x000000FF);
+#ifdef LIGHT_SSE2
+// Widen 4 pixels to 16 bits per channel, multiply each channel by its
+// intensity and narrow them back. intensities_lo and intensities_hi hold the
+// intensity of each channel of pixels 0-1 and 2-3, with LIGHT_ONE for alpha.
+static inline __m128i modulate4(__m128i pixels, __m128i intensities_lo, __m128i intensities_hi) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+    __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+    // At most 255 * 256, so the low 16 bits of the product are all of it
+    lo = _mm_srli_epi16(_mm_mullo_epi16(lo, intensities_lo), 8);
+    hi = _mm_srli_epi16(_mm_mullo_epi16(hi, intensities_hi), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+#endif
 
-    return new_color;
+#ifdef LIGHT_NEON
+// The same on NEON. Intensities go up to LIGHT_ONE, which doesn't fit in a
+// byte, so the channels are widened rather than multiplied with vmull_u8.
+static inline uint8x16_t modulate4(uint8x16_t pixels, uint16x8_t intensities_lo, uint16x8_t intensities_hi) {
+    uint16x8_t lo = vmulq_u16(vmovl_u8(vget_low_u8(pixels)), intensities_lo);
+    uint16x8_t hi = vmulq_u16(vmovl_u8(vget_high_u8(pixels)), intensities_hi);
+    return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+}
+#endif
+
+// Scale each color (in place) by its own intensity, e.g. one interpolated
+// across a span for smooth shading; 4 pixels at a time with SSE2 or NEON
+void light_modulate_colors(uint32_t *colors, const uint16_t *intensities, int count) {
+    int i = 0;
+#ifdef LIGHT_SSE2
+    // The alpha channel (the top 16 bits of each widened pixel) is kept
+    __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i alpha_one = _mm_set_epi16(LIGHT_ONE, 0, 0, 0, LIGHT_ONE, 0, 0, 0);
+    for (; i + 4 <= count; i += 4) {
+        // Spread each pixel's intensity across its four channels
+        __m128i k = _mm_loadl_epi64((const __m128i *)(intensities + i));
+        __m128i k_pairs = _mm_unpacklo_epi16(k, k);
+        __m128i k_lo = _mm_unpacklo_epi32(k_pairs, k_pairs);
+        __m128i k_hi = _mm_unpackhi_epi32(k_pairs, k_pairs);
+        k_lo = _mm_or_si128(_mm_andnot_si128(alpha_mask, k_lo), alpha_one);
+        k_hi = _mm_or_si128(_mm_andnot_si128(alpha_mask, k_hi), alpha_one);
+
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(colors + i));
+        _mm_storeu_si128((__m128i *)(colors + i), modulate4(pixels, k_lo, k_hi));
+    }
+#elif defined(LIGHT_NEON)
+    // Alpha is the last of each pixel's four (little endian) channels
+    static const uint16_t alpha_lanes[8] = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+    uint16x8_t alpha_mask = vld1q_u16(alpha_lanes);
+    uint16x8_t alpha_one = vdupq_n_u16(LIGHT_ONE);
+    for (; i + 4 <= count; i += 4) {
+        uint16x8_t k_lo = vcombine_u16(vdup_n_u16(intensities[i]), vdup_n_u16(intensities[i + 1]));
+        uint16x8_t k_hi = vcombine_u16(vdup_n_u16(intensities[i + 2]), vdup_n_u16(intensities[i + 3]));
+        k_lo = vbslq_u16(alpha_mask, alpha_one, k_lo);
+        k_hi = vbslq_u16(alpha_mask, alpha_one, k_hi);
+
+        uint8x16_t pixels = vld1q_u8((const uint8_t *)(colors + i));
+        vst1q_u8((uint8_t *)(colors + i), modulate4(pixels, k_lo, k_hi));
+    }
+#endif
+    for (; i < count; i += 1) {
+        colors[i] = light_modulate(colors[i], intensities[i]);
+    }
+}
+
+uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor) {
+    return light_modulate(original_color, light_intensity_fixed(percentage_factor));
 }
@@ -1,12 +1,20 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "vector.h"
 
 typedef struct {
     vec3_t direction;
 } light_t;
 
+// Light intensities are 8.8 fixed point, from 0 (black) to LIGHT_ONE (the
+// color unchanged); colors are scaled with an integer multiply per channel
+#define LIGHT_ONE 256
+
 void init_light(vec3_t direction);
 vec3_t get_light_direction(void);
+uint16_t light_intensity_fixed(float percentage_factor);
+uint32_t light_modulate(uint32_t color, uint16_t intensity);
+void light_modulate_colors(uint32_t *colors, const uint16_t *intensities, int count);
 uint32_t light_apply_intensity(uint32_t original_color, float percentage_factor);
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <math.h>
@@ -12,22 +14,135 @@
 #include "matrix.h"
 #include "light.h"
 #include "texture.h"
-#include "upng.h"
 #include "camera.h"
 #include "clipping.h"
-
-#define MAX_TRIANGLES_PER_MESH 10000
-triangle_t triangles_to_render[MAX_TRIANGLES_PER_MESH];
-int num_triangles_to_render = 0;
+#include "jobs.h"
+#include "profile.h"
+#include "benchmark.h"
+#include "hud.h"
+#include "stats.h"
+#include "trace.h"
+#include "golden.h"
+#include "governor.h"
+#include "scheduler.h"
+
+#define MAX_TRIANGLES_PER_MESH 131072
+#define MAX_LINES_PER_FRAME (MAX_TRIANGLES_PER_MESH * 2)
+#define MAX_POINTS_PER_FRAME MAX_TRIANGLES_PER_MESH
+
+typedef struct {
+    vec4_t points[2];
+} line_t;
+
+// Everything the geometry stages need to build one frame's triangles. The
+// camera and mesh transforms are snapshotted into it on the main thread, so
+// a worker can build it while the main thread draws the frame before it.
+typedef struct {
+    mat4_t view_matrix;
+    mat4_t world_matrices[MAX_NUMBER_MESHES];
+    mat4_t normal_matrices[MAX_NUMBER_MESHES]; // world then view, for normals
+    int num_meshes;
+    bool cull_backfaces;
+    int render_mode;
+    int shading;
+    int width, height; // internal resolution to draw at
+    triangle_t triangles[MAX_TRIANGLES_PER_MESH];
+    int num_triangles;
+    // Each unique edge and vertex of the faces that survived culling, for
+    // the wire and dot modes
+    line_t lines[MAX_LINES_PER_FRAME];
+    int num_lines;
+    vec4_t points[MAX_POINTS_PER_FRAME];
+    int num_points;
+    // Scratch dynamic arrays for the mesh being built: which faces survived
+    // culling, and the vertices they use, in view and (if inside the
+    // frustum) screen space
+    bool *face_visible;
+    bool *vertex_visible;
+    bool *vertex_inside;
+    vec4_t *view_vertices;
+    vec4_t *screen_vertices;
+    // Scratch dynamic array of the light intensity of each of the mesh's
+    // normals, for Gouraud shading
+    uint16_t *normal_shades;
+} frame_t;
+
+frame_t frames[2];
+frame_t *built_frame = &frames[0]; // being simulated and transformed
+frame_t *drawn_frame = &frames[1]; // being rasterized and presented
+
+// Frames between simulating a frame and drawing it: 0 runs every stage of a
+// frame in turn, 1 builds frame N+1 on a worker while frame N is drawn (by
+// default, given more than one core)
+int pipeline_depth = -1;
+job_group_t geometry_jobs;
+
+// Internal resolution as a fraction of the largest one, set by the user or
+// the dynamic resolution governor
+float render_scale = 1.0;
 
 // Transformation matrices
-mat4_t world_matrix;
 mat4_t proj_matrix;
-mat4_t view_matrix;
 
 bool is_running = false;
-int previous_frame_time = 0;
-float delta_time = 0;
+
+// The scene is simulated in fixed steps of delta_time seconds, however often
+// frames are drawn; simulation_lag is the real time not yet simulated
+#define SIMULATION_STEP (1.0 / 60)
+#define MAX_SIMULATION_LAG 0.25
+float delta_time = SIMULATION_STEP;
+double simulation_lag = 0;
+
+// The simulated state frames are drawn from
+typedef struct {
+    vec3_t camera_position;
+    float camera_yaw;
+    float camera_pitch;
+    int num_meshes;
+    vec3_t mesh_rotations[MAX_NUMBER_MESHES];
+    vec3_t mesh_scales[MAX_NUMBER_MESHES];
+    vec3_t mesh_translations[MAX_NUMBER_MESHES];
+} scene_state_t;
+
+// The state before the last step, for drawing frames that fall between steps
+scene_state_t previous_state;
+
+// Scene file driving a benchmark run, if any
+char *benchmark_scene = NULL;
+
+// Where to write the trace on exit, if tracing
+char *trace_filename = NULL;
+
+// Reference images to compare frames of the scene with, instead of timing it
+char *golden_dir = NULL;
+bool golden_update = false;
+
+void capture_scene_state(scene_state_t *state) {
+    state->camera_position = get_camera_position();
+    state->camera_yaw = get_camera_yaw();
+    state->camera_pitch = get_camera_pitch();
+    state->num_meshes = get_num_meshes();
+    for (int mesh_index = 0; mesh_index < state->num_meshes; mesh_index += 1) {
+        mesh_t *mesh = get_mesh(mesh_index);
+        state->mesh_rotations[mesh_index] = mesh->rotation;
+        state->mesh_scales[mesh_index] = mesh->scale;
+        state->mesh_translations[mesh_index] = mesh->translation;
+    }
+}
+
+// The state a fraction alpha of the way from a to b
+scene_state_t lerp_scene_state(const scene_state_t *a, const scene_state_t *b, float alpha) {
+    scene_state_t state = *b;
+    state.camera_position = vec3_lerp(a->camera_position, b->camera_position, alpha);
+    state.camera_yaw = a->camera_yaw + (b->camera_yaw - a->camera_yaw) * alpha;
+    state.camera_pitch = a->camera_pitch + (b->camera_pitch - a->camera_pitch) * alpha;
+    for (int mesh_index = 0; mesh_index < a->num_meshes && mesh_index < b->num_meshes; mesh_index += 1) {
+        state.mesh_rotations[mesh_index] = vec3_lerp(a->mesh_rotations[mesh_index], b->mesh_rotations[mesh_index], alpha);
+        state.mesh_scales[mesh_index] = vec3_lerp(a->mesh_scales[mesh_index], b->mesh_scales[mesh_index], alpha);
+        state.mesh_translations[mesh_index] = vec3_lerp(a->mesh_translations[mesh_index], b->mesh_translations[mesh_index], alpha);
+    }
+    return state;
+}
 
 void setup(char *model, char *texture) {
     // Configure some render options
@@ -59,8 +174,15 @@ void setup(char *model, char *texture) {
     init_frustum_planes(fovy, fovx, znear, zfar);
 
     // Load mesh and texture data
-    load_mesh("./assets/f22.obj", "./assets/f22.png", vec3_new(1, 1, 1), vec3_new(-3, 0, +8), vec3_new(0, 0, 0));
-    load_mesh("./assets/efa.obj", "./assets/efa.png", vec3_new(1, 1, 1), vec3_new(+3, 0, +8), vec3_new(0, 0, 0));
+    if (benchmark_scene) {
+        if (!load_benchmark_scene(benchmark_scene)) is_running = false;
+    } else {
+        load_mesh("./assets/f22.obj", "./assets/f22.png", vec3_new(1, 1, 1), vec3_new(-3, 0, +8), vec3_new(0, 0, 0));
+        load_mesh("./assets/efa.obj", "./assets/efa.png", vec3_new(1, 1, 1), vec3_new(+3, 0, +8), vec3_new(0, 0, 0));
+    }
+
+    // Nothing to interpolate from until the first step
+    capture_scene_state(&previous_state);
 }
 
 void process_input(void) {
@@ -93,6 +215,27 @@ void process_input(void) {
                 toggle_cull_backfaces(); break;
             case SDLK_z:
                 toggle_show_depth(); break;
+            case SDLK_o:
+                cycle_heatmap_mode(); break;
+            case SDLK_t:
+                toggle_depth_test(); break;
+            case SDLK_p:
+                cycle_texture_mapping(); break;
+            case SDLK_g:
+                cycle_shading(); break;
+            case SDLK_l:
+                toggle_wire_depth_test(); break;
+            // Internal resolution
+            case SDLK_MINUS:
+                render_scale = fmaxf(render_scale - 0.1, 0.1); break;
+            case SDLK_EQUALS:
+                render_scale = fminf(render_scale + 0.1, 1.0); break;
+#if PROFILER
+            case SDLK_h:
+                toggle_show_hud();
+                set_profiling(get_show_hud() || benchmark_scene);
+                break;
+#endif
             // Camera movement controls
             case SDLK_w:
                 set_camera_forward_velocity(vec3_mul(get_camera_direction(), 5*delta_time));
@@ -126,46 +269,251 @@ void process_input(void) {
     }
 }
 
-void process_graphics_pipeline_stages(mesh_t *mesh) {
-    // Create a scale and translation matrix that will be used to multiply the mesh vertices
-    mat4_t scale_matrix = mat4_make_scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-    mat4_t rotation_matrix_x = mat4_make_rotation_x(mesh->rotation.x);
-    mat4_t rotation_matrix_y = mat4_make_rotation_y(mesh->rotation.y);
-    mat4_t rotation_matrix_z = mat4_make_rotation_z(mesh->rotation.z);
-    mat4_t translation_matrix = mat4_make_translation(mesh->translation.x, mesh->translation.y, mesh->translation.z);
+// Snapshot the camera and the meshes' transforms, interpolated a fraction
+// alpha of the way from the previous simulation step to the last, into the
+// frame to build
+void prepare_frame(frame_t *frame, float alpha) {
+    scene_state_t state;
+    capture_scene_state(&state);
+    if (alpha < 1) state = lerp_scene_state(&previous_state, &state, alpha);
 
     // Compute the camera direction to determine the target point
     mat4_t camera_rotation = mat4_identity();
-    camera_rotation = mat4_mul_mat4(mat4_make_rotation_x(get_camera_pitch()), camera_rotation);
-    camera_rotation = mat4_mul_mat4(mat4_make_rotation_y(get_camera_yaw()), camera_rotation);
+    camera_rotation = mat4_mul_mat4(mat4_make_rotation_x(state.camera_pitch), camera_rotation);
+    camera_rotation = mat4_mul_mat4(mat4_make_rotation_y(state.camera_yaw), camera_rotation);
     set_camera_direction(vec3_from_vec4(mat4_mul_vec4(camera_rotation, vec4_from_vec3(vec3_new(0, 0, 1)))));
 
     // Offset the camera position in the direction where the camera is pointing at
-    vec3_t target = vec3_add(get_camera_position(), get_camera_direction());
+    vec3_t target = vec3_add(state.camera_position, get_camera_direction());
     
     // Create the view matrix looking at a hard-coded target point
     vec3_t up_direction = { 0, 1, 0 };
 
-    mat4_t view_matrix = mat4_look_at(get_camera_position(), target, up_direction);
+    frame->view_matrix = mat4_look_at(state.camera_position, target, up_direction);
+    frame->cull_backfaces = get_cull_backfaces();
+    frame->render_mode = get_render_mode();
+    frame->shading = get_shading();
+    frame->width = lroundf(get_max_render_width() * render_scale);
+    frame->height = lroundf(get_max_render_height() * render_scale);
+    if (frame->width < 1) frame->width = 1;
+    if (frame->height < 1) frame->height = 1;
+
+    frame->num_meshes = state.num_meshes;
+    for (int mesh_index = 0; mesh_index < frame->num_meshes; mesh_index += 1) {
+        mesh_t *mesh = get_mesh(mesh_index);
+        vec3_t scale = state.mesh_scales[mesh_index];
+        vec3_t rotation = state.mesh_rotations[mesh_index];
+        vec3_t translation = state.mesh_translations[mesh_index];
+
+        // Create a scale and translation matrix that will be used to multiply the mesh vertices
+        mat4_t scale_matrix = mat4_make_scale(scale.x, scale.y, scale.z);
+        mat4_t rotation_matrix_x = mat4_make_rotation_x(rotation.x);
+        mat4_t rotation_matrix_y = mat4_make_rotation_y(rotation.y);
+        mat4_t rotation_matrix_z = mat4_make_rotation_z(rotation.z);
+        mat4_t translation_matrix = mat4_make_translation(translation.x, translation.y, translation.z);
+
+        // Create a world matrix combining scale, rotation, and translation matrices
+        // Using matrices also means we can lift these computations outside of the loop
+        mat4_t world_matrix = mat4_identity();
+        world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
+        world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
+        world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
+        world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
+        world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+
+        // Normals aren't quantized like positions, so they skip the decode
+        frame->normal_matrices[mesh_index] = mat4_mul_mat4(frame->view_matrix, world_matrix);
+
+        // Compact meshes store positions as integers relative to their bounding
+        // box. Rather than decoding every vertex, fold the decode (scale by the
+        // step size, then offset by the box origin) into the world matrix.
+        if (is_mesh_compact(mesh)) {
+            vec3_t min = mesh->compact.position_min;
+            vec3_t step = mesh->compact.position_step;
+            mat4_t decode_matrix = mat4_mul_mat4(
+                mat4_make_translation(min.x, min.y, min.z),
+                mat4_make_scale(step.x, step.y, step.z)
+            );
+            world_matrix = mat4_mul_mat4(world_matrix, decode_matrix);
+        }
 
-    // Create a world matrix combining scale, rotation, and translation matrices
-    // Using matrices also means we can lift these computations outside of the loop
-    world_matrix = mat4_identity();
-    world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-    world_matrix = mat4_mul_mat4(rotation_matrix_z, world_matrix);
-    world_matrix = mat4_mul_mat4(rotation_matrix_y, world_matrix);
-    world_matrix = mat4_mul_mat4(rotation_matrix_x, world_matrix);
-    world_matrix = mat4_mul_mat4(translation_matrix, world_matrix);
+        frame->world_matrices[mesh_index] = world_matrix;
+    }
+
+    frame->num_triangles = 0;
+    frame->num_lines = 0;
+    frame->num_points = 0;
+}
+
+// Grow a scratch dynamic array to at least count items
+void *reserve_scratch(void *array, int count, int item_size) {
+    int length = array_length(array);
+    if (length < count) array = array_hold(array, count - length, item_size);
+    return array;
+}
+
+// Project a view space point to screen space at the frame's resolution
+vec4_t project_to_screen(frame_t *frame, vec4_t point) {
+    vec4_t projected_point = mat4_mul_vec4_project(proj_matrix, point);
+
+    // Scale into the view
+    projected_point.x *= (frame->width / 2.);
+    projected_point.y *= (frame->height / 2.);
+
+    // Invert the y values to account for flipped screen y-coordinates
+    projected_point.y *= -1;
+
+    // Translate projected point to the middle of the screen
+    projected_point.x += (frame->width / 2.);
+    projected_point.y += (frame->height / 2.);
+
+    return projected_point;
+}
+
+// Add the edges and vertices of a mesh's visible faces to the frame, each
+// once however many faces share it. An edge is drawn if either of its faces
+// survived culling.
+void process_mesh_edges(frame_t *frame, mesh_t *mesh, bool draw_wire, bool draw_dots) {
+    // Project each visible vertex once; only edges with an end outside the
+    // frustum need clipping and projecting on their own
+    int num_vertices = get_mesh_num_vertices(mesh);
+    for (int i = 0; i < num_vertices; i += 1) {
+        if (!frame->vertex_visible[i]) continue;
+        frame->vertex_inside[i] = is_point_in_frustum(vec3_from_vec4(frame->view_vertices[i]));
+        if (!frame->vertex_inside[i]) continue;
+
+        frame->screen_vertices[i] = project_to_screen(frame, frame->view_vertices[i]);
+        if (draw_dots && frame->num_points < MAX_POINTS_PER_FRAME) {
+            frame->points[frame->num_points] = frame->screen_vertices[i];
+            frame->num_points += 1;
+        }
+    }
+
+    for (int i = 0; draw_wire && i < array_length(mesh->edges); i += 1) {
+        edge_t edge = mesh->edges[i];
+        bool visible = frame->face_visible[edge.face_a] || (edge.face_b >= 0 && frame->face_visible[edge.face_b]);
+        if (!visible) continue;
+
+        line_t line;
+        if (frame->vertex_inside[edge.a] && frame->vertex_inside[edge.b]) {
+            line.points[0] = frame->screen_vertices[edge.a];
+            line.points[1] = frame->screen_vertices[edge.b];
+        } else {
+            vec3_t a = vec3_from_vec4(frame->view_vertices[edge.a]);
+            vec3_t b = vec3_from_vec4(frame->view_vertices[edge.b]);
+            if (!clip_segment(&a, &b)) continue;
+            line.points[0] = project_to_screen(frame, vec4_from_vec3(a));
+            line.points[1] = project_to_screen(frame, vec4_from_vec3(b));
+        }
+
+        if (frame->num_lines < MAX_LINES_PER_FRAME) {
+            frame->lines[frame->num_lines] = line;
+            frame->num_lines += 1;
+        }
+    }
+}
+
+// Light each of a mesh's normals once, for the faces sharing it to
+// interpolate between their corners. Normals are rotated into view space,
+// where the light is, by the world and view matrices; that's only exact for
+// uniform scales, but they're normalized again after.
+void light_mesh_normals(frame_t *frame, mesh_t *mesh, int mesh_index) {
+    mat4_t normal_matrix = frame->normal_matrices[mesh_index];
+    vec3_t light_direction = get_light_direction();
+    int num_normals = get_mesh_num_normals(mesh);
+    frame->normal_shades = reserve_scratch(frame->normal_shades, num_normals, sizeof(uint16_t));
+
+    for (int i = 0; i < num_normals; i += 1) {
+        // A direction, so w = 0 leaves out the translation
+        vec4_t normal = vec4_from_vec3(get_mesh_normal(mesh, i));
+        normal.w = 0;
+        vec3_t view_normal = vec3_from_vec4(mat4_mul_vec4(normal_matrix, normal));
+        vec3_normalize(&view_normal);
+        frame->normal_shades[i] = light_intensity_fixed(-vec3_dot(view_normal, light_direction));
+    }
+}
+
+// Transform, cull, clip and project a mesh's faces into the frame's
+// triangles. Only reads the frame's snapshot (and the mesh's geometry, which
+// doesn't change), so it's safe to run off the main thread.
+void process_graphics_pipeline_stages(frame_t *frame, int mesh_index) {
+    mesh_t *mesh = get_mesh(mesh_index);
+    mat4_t world_matrix = frame->world_matrices[mesh_index];
+    mat4_t view_matrix = frame->view_matrix;
+    bool compact = is_mesh_compact(mesh);
 
     // Loop all triangle faces
-    int num_faces = array_length(mesh->faces);
+    int num_faces = get_mesh_num_faces(mesh);
+
+    // Wireframes and dots are drawn from the unique edges and vertices of the
+    // faces that survive culling, found once all the faces are done
+    bool draw_wire = frame->render_mode & MODE_WIRE;
+    bool draw_dots = frame->render_mode & MODE_DOT;
+    bool draw_edges = draw_wire || draw_dots;
+    bool draw_faces = frame->render_mode & (MODE_SOLID | MODE_TEXTURE);
+    if (draw_edges) {
+        int num_vertices = get_mesh_num_vertices(mesh);
+        frame->face_visible = reserve_scratch(frame->face_visible, num_faces, sizeof(bool));
+        frame->vertex_visible = reserve_scratch(frame->vertex_visible, num_vertices, sizeof(bool));
+        frame->vertex_inside = reserve_scratch(frame->vertex_inside, num_vertices, sizeof(bool));
+        frame->view_vertices = reserve_scratch(frame->view_vertices, num_vertices, sizeof(vec4_t));
+        frame->screen_vertices = reserve_scratch(frame->screen_vertices, num_vertices, sizeof(vec4_t));
+        memset(frame->face_visible, 0, num_faces * sizeof(bool));
+        memset(frame->vertex_visible, 0, num_vertices * sizeof(bool));
+    }
+
+    // Gouraud shading lights each normal once here, rather than each of the
+    // face corners (or pixels) sharing it
+    bool gouraud = draw_faces && frame->shading == SHADING_GOURAUD;
+    if (gouraud) {
+        PROFILE_BEGIN(STAGE_TRANSFORM);
+        light_mesh_normals(frame, mesh, mesh_index);
+        PROFILE_END(STAGE_TRANSFORM);
+    }
+
+    pipeline_stats_t *stats = get_thread_stats();
+    stats->faces_in += num_faces;
+    // Each face ends one stage and begins the next with a single counter
+    // read, and finishing a face switches back to transform for the next one
+    PROFILE_BEGIN(STAGE_TRANSFORM);
     for (int i = 0; i < num_faces; i++) {
-        face_t mesh_face = mesh->faces[i];
-        
+        int face_indices[3];
         vec3_t face_vertices[3];
-        face_vertices[0] = mesh->vertices[mesh_face.a];
-        face_vertices[1] = mesh->vertices[mesh_face.b];
-        face_vertices[2] = mesh->vertices[mesh_face.c];
+        tex2_t face_texcoords[3];
+        int face_normals[3];
+        uint32_t face_color;
+
+        if (compact) {
+            qface_t mesh_face = mesh->compact.faces[i];
+            face_indices[0] = mesh_face.a;
+            face_indices[1] = mesh_face.b;
+            face_indices[2] = mesh_face.c;
+            face_vertices[0] = qvec3_to_vec3(mesh->compact.vertices[mesh_face.a]);
+            face_vertices[1] = qvec3_to_vec3(mesh->compact.vertices[mesh_face.b]);
+            face_vertices[2] = qvec3_to_vec3(mesh->compact.vertices[mesh_face.c]);
+            face_texcoords[0] = qtex2_decode(mesh_face.a_uv, mesh->compact.uv_min, mesh->compact.uv_step);
+            face_texcoords[1] = qtex2_decode(mesh_face.b_uv, mesh->compact.uv_min, mesh->compact.uv_step);
+            face_texcoords[2] = qtex2_decode(mesh_face.c_uv, mesh->compact.uv_min, mesh->compact.uv_step);
+            face_normals[0] = mesh_face.a_normal;
+            face_normals[1] = mesh_face.b_normal;
+            face_normals[2] = mesh_face.c_normal;
+            face_color = mesh->compact.color;
+        } else {
+            face_t mesh_face = mesh->faces[i];
+            face_indices[0] = mesh_face.a;
+            face_indices[1] = mesh_face.b;
+            face_indices[2] = mesh_face.c;
+            face_vertices[0] = mesh->vertices[mesh_face.a];
+            face_vertices[1] = mesh->vertices[mesh_face.b];
+            face_vertices[2] = mesh->vertices[mesh_face.c];
+            face_texcoords[0] = mesh_face.a_uv;
+            face_texcoords[1] = mesh_face.b_uv;
+            face_texcoords[2] = mesh_face.c_uv;
+            face_normals[0] = mesh_face.a_normal;
+            face_normals[1] = mesh_face.b_normal;
+            face_normals[2] = mesh_face.c_normal;
+            face_color = mesh_face.color;
+        }
 
         vec4_t transformed_vertices[3];
 
@@ -183,10 +531,12 @@ void process_graphics_pipeline_stages(mesh_t *mesh) {
             transformed_vertices[j] = transformed_vertex;
         }
 
+        PROFILE_SWITCH(STAGE_TRANSFORM, STAGE_CULL);
+
         // Get normals for backface culling
         vec3_t face_normal = get_triangle_normal(transformed_vertices);
 
-        if (get_cull_backfaces()) {
+        if (frame->cull_backfaces) {
             // Get the camera ray vector
             vec3_t camera_ray = vec3_sub(vec3_new(0, 0, 0), vec3_from_vec4(transformed_vertices[0]));
 
@@ -195,28 +545,57 @@ void process_graphics_pipeline_stages(mesh_t *mesh) {
 
             // Bypass triangles looking away from the camera
             if (dot_normal_camera < 0) {
+                stats->faces_culled += 1;
+                PROFILE_SWITCH(STAGE_CULL, STAGE_TRANSFORM);
                 continue;
             }
         }
 
+        if (draw_edges) {
+            frame->face_visible[i] = true;
+            for (int j = 0; j < 3; j++) {
+                frame->vertex_visible[face_indices[j]] = true;
+                frame->view_vertices[face_indices[j]] = transformed_vertices[j];
+            }
+        }
+
+        // Without filled faces, the edges and vertices are all that's drawn
+        if (!draw_faces) {
+            PROFILE_SWITCH(STAGE_CULL, STAGE_TRANSFORM);
+            continue;
+        }
+
+        PROFILE_SWITCH(STAGE_CULL, STAGE_CLIP);
+
         // Create a polygon from the orignal transformed triangle to be clipped
         polygon_t polygon = create_polygon_from_triangle(
             vec3_from_vec4(transformed_vertices[0]),
             vec3_from_vec4(transformed_vertices[1]),
             vec3_from_vec4(transformed_vertices[2]),
-            mesh_face.a_uv,
-            mesh_face.b_uv,
-            mesh_face.c_uv
+            face_texcoords[0],
+            face_texcoords[1],
+            face_texcoords[2]
         );
+        for (int j = 0; j < 3; j++) {
+            polygon.intensities[j] = gouraud ? frame->normal_shades[face_normals[j]] : LIGHT_ONE;
+        }
 
         // Clip the polygon (in place) and return a new polygon with potential new vertices
-        clip_polygon(&polygon);
+        bool clipped = clip_polygon(&polygon);
+        if (polygon.num_vertices < 3) {
+            stats->faces_rejected += 1;
+        } else if (clipped) {
+            stats->faces_clipped += 1;
+        }
 
         // Break the clipped polygon into triangles
         triangle_t triangles_after_clipping[MAX_NUM_POLY_TRIANGLES];
         int num_triangles_after_clipping = 0;
 
         triangles_from_polygon(&polygon, triangles_after_clipping, &num_triangles_after_clipping);
+        stats->triangles_emitted += num_triangles_after_clipping;
+
+        PROFILE_SWITCH(STAGE_CLIP, STAGE_PROJECT);
 
         // Loops all the assembled triangles after clipping
         for (int t = 0; t < num_triangles_after_clipping; t += 1) {
@@ -226,25 +605,17 @@ void process_graphics_pipeline_stages(mesh_t *mesh) {
 
             // Loop all three vertices to perform projection
             for (int j = 0; j < 3; j++) {
-                // Project the current vertex
-                projected_points[j] = mat4_mul_vec4_project(proj_matrix, triangle_after_clipping.points[j]);
-
-                // Scale into the view
-                projected_points[j].x *= (get_window_width() / 2.);
-                projected_points[j].y *= (get_window_height() / 2.);
-
-                // Invert the y values to account for flipped screen y-coordinates
-                projected_points[j].y *= -1;
-
-                // Translate projected point to the middle of the screen
-                projected_points[j].x += (get_window_width() / 2.);
-                projected_points[j].y += (get_window_height() / 2.);
+                projected_points[j] = project_to_screen(frame, triangle_after_clipping.points[j]);
             }
 
-            // Calculate the color intensity based on (inverted) light sources and face normals
-            float dot_normal_light = vec3_dot(face_normal, get_light_direction()); 
-            float intensity = -dot_normal_light;
-            uint32_t color = light_apply_intensity(mesh_face.color, intensity);
+            // Calculate the color intensity based on (inverted) light sources and face normals,
+            // unless it's lit per pixel from the intensities at the corners
+            uint32_t color = face_color;
+            if (!gouraud) {
+                float dot_normal_light = vec3_dot(face_normal, get_light_direction()); 
+                float intensity = -dot_normal_light;
+                color = light_apply_intensity(face_color, intensity);
+            }
 
             triangle_t triangle_to_render = {
                 .points = {
@@ -257,68 +628,143 @@ void process_graphics_pipeline_stages(mesh_t *mesh) {
                     { triangle_after_clipping.texcoords[1].u, triangle_after_clipping.texcoords[1].v },
                     { triangle_after_clipping.texcoords[2].u, triangle_after_clipping.texcoords[2].v }
                 },
+                .intensities = {
+                    triangle_after_clipping.intensities[0],
+                    triangle_after_clipping.intensities[1],
+                    triangle_after_clipping.intensities[2]
+                },
                 .color = color,
-                .texture = mesh->texture,
+                .texture = get_mesh_texture(mesh),
             };
 
             // Save the projected triangle in the array of triangles to render
-            if (num_triangles_to_render < MAX_TRIANGLES_PER_MESH) {
-                triangles_to_render[num_triangles_to_render] = triangle_to_render;
-                num_triangles_to_render += 1;
+            if (frame->num_triangles < MAX_TRIANGLES_PER_MESH) {
+                frame->triangles[frame->num_triangles] = triangle_to_render;
+                frame->num_triangles += 1;
             }
         }
-    }
-}
-
-void update(void) {
-    // It's a black box, but it's preferable to just spinning the CPU uselessly
-    int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
 
-    if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
-        SDL_Delay(time_to_wait);
+        PROFILE_SWITCH(STAGE_PROJECT, STAGE_TRANSFORM);
     }
+    PROFILE_END(STAGE_TRANSFORM);
 
-    // Get a delta time factor converted to seconds to be used to update our game objects
-    delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0;
+    if (draw_edges) {
+        PROFILE_BEGIN(STAGE_PROJECT);
+        process_mesh_edges(frame, mesh, draw_wire, draw_dots);
+        PROFILE_END(STAGE_PROJECT);
+    }
+}
 
-    // Discouraged; use a proper delay function so the CPU can focus on
-    // other tasks if needed
-    // while (!SDL_TICKS_PASSED(SDL_GetTicks(), previous_frame_time + FRAME_TARGET_TIME));
+// Wait until the next frame is due and add the time since the last one to
+// the simulation's backlog
+void wait_for_next_frame(void) {
+    // Benchmarks run as fast as possible with a fixed time step
+    if (benchmark_scene) {
+        delta_time = get_benchmark_delta_time();
+        simulation_lag += delta_time;
+        return;
+    }
 
-    previous_frame_time = SDL_GetTicks();
+    // After a long stall (or a breakpoint), carry on rather than trying to
+    // simulate all of it at once
+    simulation_lag += fmin(wait_for_frame(), MAX_SIMULATION_LAG);
+}
 
-    // Initialize the counter of triangles to render for the current frame
-    num_triangles_to_render = 0;
+// Advance the scene by one step of delta_time
+void simulate(void) {
+    // In benchmarks the scene script drives the camera and meshes
+    if (benchmark_scene) update_benchmark_scene();
 
     // Loop all meshes in the scene
     for (int mesh_index = 0; mesh_index < get_num_meshes(); mesh_index += 1) {
         mesh_t *mesh = get_mesh(mesh_index);
 
-        mesh->rotation.x += 0.6 * delta_time;
+        if (!benchmark_scene) mesh->rotation.x += 0.6 * delta_time;
         // mesh.rotation.y += 0.6 * delta_time;;
         // mesh.rotation.z += 0.5 * delta_time;;
         // mesh.scale.x += 0.002 * delta_time;;
         // mesh.scale.y += 0.001 * delta_time;;
         // mesh.translation.x += 0.01 * delta_time;;
         // mesh.translation.z = 5.0;
-        
-        process_graphics_pipeline_stages(mesh);
+    }
+}
+
+// Simulate the steps real time has caught up with, then snapshot the scene
+// into the frame to build next
+void update(frame_t *frame) {
+    while (simulation_lag >= delta_time) {
+        capture_scene_state(&previous_state);
+        simulate();
+        simulation_lag -= delta_time;
+    }
 
+    // Frames drawn between steps are interpolated between the last two,
+    // which puts them up to a step behind. Benchmarks take a step every
+    // frame and draw exactly that.
+    float alpha = benchmark_scene ? 1 : simulation_lag / delta_time;
+    prepare_frame(frame, alpha);
+}
 
+// Build the triangles of a frame prepared by update (a job_fn)
+void build_frame(void *arg) {
+    frame_t *frame = arg;
+    for (int mesh_index = 0; mesh_index < frame->num_meshes; mesh_index += 1) {
+        process_graphics_pipeline_stages(frame, mesh_index);
     }
 }
 
-void render(void) {
-    clear_color_buffer(0xFF000000);
-    clear_z_buffer();
+void swap_frames(void) {
+    frame_t *frame = drawn_frame;
+    drawn_frame = built_frame;
+    built_frame = frame;
+}
 
-    draw_checker(180 / 4 /* GCD scaled down */);
+void render(frame_t *frame) {
+    PROFILE_BEGIN(STAGE_CLEAR);
+    set_render_resolution(frame->width, frame->height);
+    acquire_color_buffer();
+    clear_frame_to_checker(0xFF000000, 180 / 4 /* GCD scaled down */);
+    if (get_heatmap_mode() != HEATMAP_OFF) clear_heatmap();
+    PROFILE_END(STAGE_CLEAR);
+
+    PROFILE_BEGIN(STAGE_RASTERIZE);
+
+    // The render state is fixed for the whole batch, so look at it once
+    begin_raster_batch();
+    int mode = frame->render_mode;
+    bool draw_solid = mode & MODE_SOLID;
+    bool draw_textured = mode & MODE_TEXTURE;
+    bool draw_wire = mode & MODE_WIRE;
+    bool draw_dots = mode & MODE_DOT;
+    bool wire_depth_test = get_wire_depth_test();
 
     // Loop all projected points and render them
-    for (int i = 0; i < num_triangles_to_render; i++) {
-        triangle_t triangle = triangles_to_render[i];
-
-        if (get_render_mode() & MODE_SOLID) {
+    for (int i = 0; i < frame->num_triangles; i++) {
+        triangle_t triangle = frame->triangles[i];
+
+        // Meshes whose texture is still being decoded are drawn flat shaded
+        bool textured = draw_textured && triangle.texture;
+        bool solid = draw_solid || (draw_textured && !textured);
+        if (solid && frame->shading == SHADING_GOURAUD) {
+            draw_shaded_triangle(
+                triangle.points[0].x,
+                triangle.points[0].y,
+                triangle.points[0].z,
+                triangle.points[0].w,
+                triangle.intensities[0],
+                triangle.points[1].x,
+                triangle.points[1].y,
+                triangle.points[1].z,
+                triangle.points[1].w,
+                triangle.intensities[1],
+                triangle.points[2].x,
+                triangle.points[2].y,
+                triangle.points[2].z,
+                triangle.points[2].w,
+                triangle.intensities[2],
+                triangle.color
+            );
+        } else if (solid) {
             // Connect points in the triangle
             draw_filled_triangle(
                 triangle.points[0].x,
@@ -337,7 +783,7 @@ void render(void) {
             );
         }
 
-        if (get_render_mode() & MODE_TEXTURE) {
+        if (textured) {
             draw_textured_triangle(
                 // P0
                 triangle.points[0].x,
@@ -365,59 +811,374 @@ void render(void) {
             );
         }
 
-        if (get_render_mode() & MODE_WIRE) {
-            draw_triangle(
-                triangle.points[0].x,
-                triangle.points[0].y,
-                triangle.points[1].x,
-                triangle.points[1].y,
-                triangle.points[2].x,
-                triangle.points[2].y,
+    }
+
+    // Draw each unique visible edge once, over the filled triangles
+    for (int i = 0; draw_wire && i < frame->num_lines; i += 1) {
+        line_t line = frame->lines[i];
+        if (wire_depth_test) {
+            draw_line_depth(
+                line.points[0].x, line.points[0].y, line.points[0].w,
+                line.points[1].x, line.points[1].y, line.points[1].w,
                 0xFFFFFFFF
             );
+        } else {
+            draw_line(line.points[0].x, line.points[0].y, line.points[1].x, line.points[1].y, 0xFFFFFFFF);
         }
+    }
 
-        if (get_render_mode() & MODE_DOT) {
-            int dot = 2;
-            // Draw vertex points
-            draw_rect(triangle.points[0].x - dot/2, triangle.points[0].y - dot/2, dot, dot, 0xFFFF0000);
-            draw_rect(triangle.points[1].x - dot/2, triangle.points[1].y - dot/2, dot, dot, 0xFFFF0000);
-            draw_rect(triangle.points[2].x - dot/2, triangle.points[2].y - dot/2, dot, dot, 0xFFFF0000);
-        }
+    // And each unique visible vertex once
+    for (int i = 0; draw_dots && i < frame->num_points; i += 1) {
+        int dot = 2;
+        draw_rect(frame->points[i].x - dot/2, frame->points[i].y - dot/2, dot, dot, 0xFFFF0000);
+    }
 
+    PROFILE_END(STAGE_RASTERIZE);
+
+    if (get_heatmap_mode() != HEATMAP_OFF) {
+        PROFILE_BEGIN(STAGE_DEBUG_VIEW);
+        draw_heatmap();
+        PROFILE_END(STAGE_DEBUG_VIEW);
+    } else if (get_show_depth()) {
+        PROFILE_BEGIN(STAGE_DEBUG_VIEW);
+        draw_z_buffer();
+        PROFILE_END(STAGE_DEBUG_VIEW);
     }
 
-    if (get_show_depth()) {
-        render_z_buffer();
-    } else {
-        render_color_buffer();
+#if PROFILER
+    PROFILE_BEGIN(STAGE_HUD);
+    draw_hud();
+    PROFILE_END(STAGE_HUD);
+#endif
+
+    PROFILE_BEGIN(STAGE_PRESENT);
+    render_color_buffer();
+    PROFILE_END(STAGE_PRESENT);
+}
+
+// Render one frame of the scene in each render mode, with culling on and
+// off, and compare each with its reference image (or replace them all)
+static bool run_golden_tests(void) {
+    int modes[] = { MODE_WIREDOT, MODE_WIRE, MODE_SOLID, MODE_SOLIDWIRE, MODE_TEXTURE, MODE_TEXTUREWIRE };
+    int num_modes = sizeof(modes) / sizeof(modes[0]);
+
+    // References are drawn at the full internal resolution
+    render_scale = 1.0;
+    set_governor_bounds(1.0, 1.0);
+
+    int num_failed = 0;
+    for (int i = 0; i < num_modes; i += 1) {
+        for (int cull = 1; cull >= 0; cull -= 1) {
+            set_render_mode(modes[i]);
+            set_cull_backfaces(cull);
+
+            // Always unpipelined, so the frame drawn is the one just set up
+            wait_for_next_frame();
+            update(built_frame);
+            build_frame(built_frame);
+            render(built_frame);
+
+            char name[64];
+            snprintf(name, sizeof(name), "%s-cull-%s", get_render_mode_name(modes[i]), cull ? "on" : "off");
+            bool ok = golden_update
+                ? update_golden_image(golden_dir, name)
+                : check_golden_image(golden_dir, name);
+            if (!ok) num_failed += 1;
+        }
+    }
+
+    if (num_failed > 0) {
+        fprintf(stderr, "%d of %d golden images failed.\n", num_failed, 2 * num_modes);
     }
+    return num_failed == 0;
 }
 
 // Free any dynamically-allocated memory
 void free_resources(void) {
     free_meshes();
+    free_benchmark();
+    free_jobs();
+
+    for (int i = 0; i < 2; i += 1) {
+        array_free(frames[i].face_visible);
+        array_free(frames[i].vertex_visible);
+        array_free(frames[i].vertex_inside);
+        array_free(frames[i].view_vertices);
+        array_free(frames[i].screen_vertices);
+        array_free(frames[i].normal_shades);
+    }
+
+    // Only once the workers are gone is every trace buffer complete
+    if (trace_filename) write_trace(trace_filename);
+    free_trace();
+
     destroy_window();
 }
 
+static void print_usage(char *program) {
+    fprintf(stderr,
+        "usage: %s [options] [model.obj texture.png]\n"
+        "  --headless WxH    render without a window at the given resolution\n"
+        "  --frames N        quit after N frames\n"
+        "  --dump PATTERN    write headless frames to files named by a printf\n"
+        "                    pattern with one %%d for the frame number, e.g.\n"
+        "                    frame%%04d.png (PNG for .png, PPM otherwise)\n"
+        "  --bench SCENE     benchmark a scripted scene with a fixed time step\n"
+        "                    (1000 frames unless --frames is given)\n"
+        "  --pipeline N      frames of latency (0 or 1) between simulating a frame\n"
+        "                    and drawing it; with 1, the next frame is transformed\n"
+        "                    on a worker while this one is drawn (default: 1 with\n"
+        "                    more than one core, 0 otherwise)\n"
+        "  --resolution WxH  internal resolution in a window, scaled up to fit it\n"
+        "                    when presenting (default: half the display)\n"
+        "  --scale S         draw at S (0 to 1) times the internal resolution\n"
+        "                    (step with - and =)\n"
+        "  --dynamic-resolution MIN[:MAX]\n"
+        "                    scale the internal resolution between MIN and MAX\n"
+        "                    (default 1) to hold the frame rate\n"
+        "  --uncapped        draw frames as fast as possible, rather than at most\n"
+        "                    60 per second (the simulation still runs in real time)\n"
+        "  --zero-copy       draw straight into the locked SDL texture rather than\n"
+        "                    copying the frame into it to present\n"
+        "  --compact         store meshes quantized to 16 bits per component (see\n"
+        "                    quantize.h), falling back to floats for meshes that\n"
+        "                    don't fit\n"
+        "  --hud             start with the debug HUD shown (toggle with H)\n"
+        "  --texture MAPPING[:N]\n"
+        "                    map textures exactly per pixel (perspective, the\n"
+        "                    default), exactly every N pixels and linearly in\n"
+        "                    between (subdivided, N 16 by default) or linearly\n"
+        "                    (affine) across spans (cycle with P)\n"
+        "  --shading KIND    light filled faces once per face (KIND flat, the\n"
+        "                    default) or smoothly from their vertex normals (KIND\n"
+        "                    gouraud) (cycle with G)\n"
+        "  --heatmap KIND    show per-pixel overdraw (KIND overdraw) or depth\n"
+        "                    tests (KIND depth) instead of colors (cycle with O)\n"
+        "  --golden DIR      with --bench, check a frame of the scene in each render\n"
+        "                    mode, culling on and off, against DIR/<mode>-cull-\n"
+        "                    <on|off>.png (headless, 320x240 unless --headless)\n"
+        "  --golden-update   with --golden, replace the reference images instead\n"
+        "  --trace FILE      record a timeline of frame stages, loading and worker\n"
+        "                    jobs, written to FILE as Chrome trace-event JSON\n"
+        "  --report FILE     write the benchmark results to FILE, as CSV for .csv\n"
+        "                    and JSON otherwise (default: JSON on stdout)\n",
+        program
+    );
+}
+
 int main(int argc, char *argv[]) {
     char *model = "./assets/f22.obj";
     char *texture = "./assets/f22.png";
+    int max_frames = 0;
+    char *report = NULL;
+    int heatmap_mode = HEATMAP_OFF;
+
+    int num_positional = 0;
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            int width, height;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            set_display_backend(DISPLAY_HEADLESS);
+            set_internal_resolution(width, height);
+        } else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+            int width, height;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            set_internal_resolution(width, height);
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            render_scale = atof(argv[++i]);
+            if (render_scale <= 0 || render_scale > 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--dynamic-resolution") == 0 && i + 1 < argc) {
+            float min = 0, max = 1;
+            if (sscanf(argv[++i], "%f:%f", &min, &max) < 1 || min <= 0 || max > 1 || min > max) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            set_governor_bounds(min, max);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            if (!set_frame_dump(argv[++i])) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            benchmark_scene = argv[++i];
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipeline_depth = atoi(argv[++i]);
+            if (pipeline_depth < 0 || pipeline_depth > 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--uncapped") == 0) {
+            set_uncapped(true);
+        } else if (strcmp(argv[i], "--zero-copy") == 0) {
+            set_zero_copy(true);
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            set_compact_meshes(true);
+        } else if (strcmp(argv[i], "--hud") == 0) {
+            set_show_hud(true);
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            char mapping[16] = "";
+            int subdivision = get_texture_subdivision();
+            if (sscanf(argv[++i], "%15[a-z]:%d", mapping, &subdivision) < 1 || subdivision < 1) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (strcmp(mapping, "perspective") == 0) {
+                set_texture_mapping(TEXTURE_PERSPECTIVE);
+            } else if (strcmp(mapping, "subdivided") == 0) {
+                set_texture_mapping(TEXTURE_SUBDIVIDED);
+            } else if (strcmp(mapping, "affine") == 0) {
+                set_texture_mapping(TEXTURE_AFFINE);
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+            set_texture_subdivision(subdivision);
+        } else if (strcmp(argv[i], "--shading") == 0 && i + 1 < argc) {
+            i += 1;
+            if (strcmp(argv[i], "flat") == 0) {
+                set_shading(SHADING_FLAT);
+            } else if (strcmp(argv[i], "gouraud") == 0) {
+                set_shading(SHADING_GOURAUD);
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            i += 1;
+            if (strcmp(argv[i], "overdraw") == 0) {
+                heatmap_mode = HEATMAP_OVERDRAW;
+            } else if (strcmp(argv[i], "depth") == 0) {
+                heatmap_mode = HEATMAP_DEPTH_COMPLEXITY;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_dir = argv[++i];
+        } else if (strcmp(argv[i], "--golden-update") == 0) {
+            golden_update = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report = argv[++i];
+        } else if (argv[i][0] != '-' && num_positional < 2) {
+            if (num_positional == 0) model = argv[i];
+            if (num_positional == 1) texture = argv[i];
+            num_positional += 1;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (golden_dir && !benchmark_scene) {
+        print_usage(argv[0]);
+        return 1;
+    }
 
-    if (argc == 3) {
-        model = argv[1];
-        texture = argv[2];
+    // Golden images are only ever rendered headless
+    if (golden_dir && get_display_backend() != DISPLAY_HEADLESS) {
+        set_display_backend(DISPLAY_HEADLESS);
+        set_internal_resolution(320, 240);
     }
 
     is_running = initialize_window();
 
+    // The heatmap is sized to the window, so wait until it exists
+    if (is_running) set_heatmap_mode(heatmap_mode);
+
+    set_tracing(trace_filename != NULL);
+
+    // Worker threads for loading and building frames (one per core left
+    // after the main thread)
+    init_jobs(0);
+
+    // Overlapping frames only pays off with a core to spare for it
+    if (pipeline_depth < 0) pipeline_depth = SDL_GetCPUCount() > 1 ? 1 : 0;
+
+    TRACE_BEGIN("setup");
     setup(model, texture);
+    TRACE_END("setup");
+
+    if (golden_dir) {
+        bool passed = is_running && run_golden_tests();
+        free_resources();
+        return passed ? 0 : 1;
+    }
+
+    if (benchmark_scene && max_frames == 0) max_frames = 1000;
+
+    // Benchmarks always record stage times; otherwise only while the HUD shows
+    set_profiling(get_show_hud() || benchmark_scene);
+
+    // With pipelining, the first frame is only built, as there's no frame
+    // before it to draw meanwhile
+    bool frame_built = false;
 
+    int num_frames = 0;
     while (is_running) {
+        wait_for_next_frame();
+        uint64_t frame_start = SDL_GetPerformanceCounter();
+
+        PROFILE_BEGIN_FRAME();
+        begin_stats_frame();
+
+        PROFILE_BEGIN(STAGE_INPUT);
         process_input();
-        update();
-        render();
+        PROFILE_END(STAGE_INPUT);
+
+        PROFILE_BEGIN(STAGE_UPDATE);
+        update(built_frame);
+        if (pipeline_depth == 0) {
+            build_frame(built_frame);
+            swap_frames();
+        }
+        PROFILE_END(STAGE_UPDATE);
+
+        bool rendered = true;
+        if (pipeline_depth > 0 && !frame_built) {
+            build_frame(built_frame);
+            swap_frames();
+            frame_built = true;
+            rendered = false;
+        } else if (pipeline_depth > 0) {
+            // Build the next frame while drawing this one. Only the main
+            // thread touches SDL, so rasterizing and presenting stay here.
+            // The geometry stats and stage times of this loop are then the
+            // next frame's, and the raster ones this frame's.
+            submit_job(&geometry_jobs, build_frame, built_frame);
+            render(drawn_frame);
+            wait_job_group(&geometry_jobs);
+            swap_frames();
+        } else {
+            render(drawn_frame);
+        }
+
+        PROFILE_END_FRAME();
+        end_stats_frame();
+        if (!rendered) continue;
+
+        // Timed here rather than by the profiler, which can be compiled out
+        double frame_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0 / SDL_GetPerformanceFrequency();
+        if (benchmark_scene) record_benchmark_frame(frame_ms);
+        render_scale = update_governor(render_scale, frame_ms);
+
+        num_frames += 1;
+        if (max_frames > 0 && num_frames >= max_frames) is_running = false;
     }
+
+    if (benchmark_scene) write_benchmark_report(report);
     
     free_resources();
 
@@ -1,21 +1,58 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <SDL2/SDL.h>
 
 #include "mesh.h"
 #include "triangle.h"
 #include "array.h"
 #include "texture.h"
+#include "jobs.h"
+#include "trace.h"
 
 #define MAX_BUFFER_SIZE 512
 
-#define MAX_NUMBER_MESHES 10
 static mesh_t meshes[MAX_NUMBER_MESHES];
 static int mesh_count = 0;
 
+static bool compact_meshes = false;
+
+// Texture decodes still in flight on the worker pool
+static job_group_t texture_jobs;
+
+typedef struct {
+    mesh_t *mesh;
+    char png_filename[MAX_BUFFER_SIZE];
+} texture_job_t;
+
+bool get_compact_meshes(void) {
+    return compact_meshes;
+}
+
+void set_compact_meshes(bool setting) {
+    compact_meshes = setting;
+}
+
+static void load_mesh_png_job(void *arg) {
+    texture_job_t *job = arg;
+    load_mesh_png_data(job->mesh, job->png_filename);
+    free(job);
+}
+
 void load_mesh(char *obj_filename, char *png_filename, vec3_t scale, vec3_t translation, vec3_t rotation) {
+    // Decode the texture on the worker pool, overlapping the OBJ parsing
+    // below (and other meshes' textures). The mesh renders untextured until
+    // the texture is published.
+    texture_job_t *job = malloc(sizeof(texture_job_t));
+    job->mesh = &meshes[mesh_count];
+    snprintf(job->png_filename, sizeof(job->png_filename), "%s", png_filename);
+    submit_job(&texture_jobs, load_mesh_png_job, job);
+
     load_mesh_obj_data(&meshes[mesh_count], obj_filename);
-    load_mesh_png_data(&meshes[mesh_count], png_filename);
+    build_mesh_edges(&meshes[mesh_count]);
+    if (compact_meshes && !mesh_compact(&meshes[mesh_count])) {
+        fprintf(stderr, "Can't use compact storage for %s, keeping floats.\n", obj_filename);
+    }
     meshes[mesh_count].scale = scale;
     meshes[mesh_count].translation = translation;
     meshes[mesh_count].rotation = rotation;
@@ -69,10 +106,52 @@ static tex2_t obj_file_parse_texture_coordinate(char *line) {
     };
 }
 
-static face_t obj_file_parse_face(char *line, tex2_t *texture_coordinates) {
-    int vertex_indices[3];
-    int texture_indices[3];
-    int normal_indices[3];
+static vec3_t obj_file_parse_normal(char *line) {
+    float normal_components[3] = {0};
+    int i = 0;
+
+    // Vertex normal data should have the form
+    // vn <float> <float> <float>
+    char *sub = line + 3;
+    char *ptr = strchr(sub, ' ');
+    while (ptr && i < 3) {
+        *ptr = 0;
+        normal_components[i] = atof(sub);
+
+        sub = ptr + 1;
+        ptr = strchr(sub, ' ');
+        i += 1;
+    }
+
+    vec3_t normal = {
+        .x = normal_components[0],
+        .y = normal_components[1],
+        .z = normal_components[2],
+    };
+    vec3_normalize(&normal);
+    return normal;
+}
+
+static tex2_t obj_file_get_texture_coordinate(tex2_t *texture_coordinates, int index) {
+    // Not every model has texture coordinates, in which case the index is
+    // left at zero (OBJ indices start at one)
+    if (index < 1 || index > array_length(texture_coordinates)) {
+        return (tex2_t) { 0, 0 };
+    }
+    return texture_coordinates[index - 1];
+}
+
+// The zero-based index of a vertex normal, or -1 for a face corner without
+// one (to be generated by build_mesh_normals)
+static int obj_file_get_normal_index(vec3_t *normals, int index) {
+    if (index < 1 || index > array_length(normals)) return -1;
+    return index - 1;
+}
+
+static face_t obj_file_parse_face(char *line, tex2_t *texture_coordinates, vec3_t *normals) {
+    int vertex_indices[3] = {0};
+    int texture_indices[3] = {0};
+    int normal_indices[3] = {0};
     int i = 0;
 
     // There are four possible formats for face elements
@@ -85,9 +164,10 @@ static face_t obj_file_parse_face(char *line, tex2_t *texture_coordinates) {
     // C4 - Vertex normal indices without texture coordinate indices
     //      f <int>//<int> <int>//<int> <int>//<int>
 
+    // Only triangles are supported, so any vertices past the third are ignored
     char *sub = line + 2;
     char *ptr = strchr(sub, ' ');
-    while (ptr) {
+    while (ptr && i < 3) {
         *ptr = 0;
 
         char *s = strchr(sub, '/');
@@ -123,9 +203,12 @@ static face_t obj_file_parse_face(char *line, tex2_t *texture_coordinates) {
         .a = vertex_indices[0] - 1,
         .b = vertex_indices[1] - 1,
         .c = vertex_indices[2] - 1,
-        .a_uv = texture_coordinates[texture_indices[0] - 1],
-        .b_uv = texture_coordinates[texture_indices[1] - 1],
-        .c_uv = texture_coordinates[texture_indices[2] - 1],
+        .a_uv = obj_file_get_texture_coordinate(texture_coordinates, texture_indices[0]),
+        .b_uv = obj_file_get_texture_coordinate(texture_coordinates, texture_indices[1]),
+        .c_uv = obj_file_get_texture_coordinate(texture_coordinates, texture_indices[2]),
+        .a_normal = obj_file_get_normal_index(normals, normal_indices[0]),
+        .b_normal = obj_file_get_normal_index(normals, normal_indices[1]),
+        .c_normal = obj_file_get_normal_index(normals, normal_indices[2]),
         .color = 0xFFFFFFFF,
     };
 }
@@ -141,6 +224,7 @@ void load_mesh_obj_data(mesh_t *mesh, char *obj_filename) {
     char line[MAX_BUFFER_SIZE] = {0};
     tex2_t *texture_coordinates = NULL;
 
+    TRACE_BEGIN("obj_parse");
     char *result = fgets(line, MAX_BUFFER_SIZE-2, file);
     while (result) {
         int len = strlen(line);
@@ -151,24 +235,263 @@ void load_mesh_obj_data(mesh_t *mesh, char *obj_filename) {
             array_push(mesh->vertices, obj_file_parse_vertex(line));
         if (strncmp(line, "vt ", 3) == 0)
             array_push(texture_coordinates, obj_file_parse_texture_coordinate(line));
+        if (strncmp(line, "vn ", 3) == 0)
+            array_push(mesh->normals, obj_file_parse_normal(line));
         if (strncmp(line, "f ", 2) == 0)
-            array_push(mesh->faces, obj_file_parse_face(line, texture_coordinates));
+            array_push(mesh->faces, obj_file_parse_face(line, texture_coordinates, mesh->normals));
 
         result = fgets(line, MAX_BUFFER_SIZE-2, file);
     }
 
+    TRACE_END("obj_parse");
+
     array_free(texture_coordinates);
     fclose(file);
+
+    build_mesh_normals(mesh);
+}
+
+// Give every face corner without a normal from the file a smooth one: the
+// sum of the normals of the faces around its vertex, each as long as twice
+// the face's area (the cross product of two of its edges, unnormalized), so
+// larger faces weigh more.
+void build_mesh_normals(mesh_t *mesh) {
+    int num_faces = array_length(mesh->faces);
+    int num_vertices = array_length(mesh->vertices);
+
+    bool missing = false;
+    for (int i = 0; i < num_faces; i += 1) {
+        face_t face = mesh->faces[i];
+        if (face.a_normal < 0 || face.b_normal < 0 || face.c_normal < 0) missing = true;
+    }
+    if (!missing) return;
+
+    // One generated normal per vertex, after any from the file
+    int base = array_length(mesh->normals);
+    mesh->normals = array_hold(mesh->normals, num_vertices, sizeof(vec3_t));
+    vec3_t *vertex_normals = mesh->normals + base;
+    for (int i = 0; i < num_vertices; i += 1) {
+        vertex_normals[i] = vec3_new(0, 0, 0);
+    }
+
+    for (int i = 0; i < num_faces; i += 1) {
+        face_t face = mesh->faces[i];
+        if (face.a < 0 || face.b < 0 || face.c < 0) continue;
+        if (face.a >= num_vertices || face.b >= num_vertices || face.c >= num_vertices) continue;
+
+        // Same winding as get_triangle_normal, so it lights the same way
+        vec3_t ab = vec3_sub(mesh->vertices[face.b], mesh->vertices[face.a]);
+        vec3_t ac = vec3_sub(mesh->vertices[face.c], mesh->vertices[face.a]);
+        vec3_t weighted_normal = vec3_cross(ab, ac);
+        vertex_normals[face.a] = vec3_add(vertex_normals[face.a], weighted_normal);
+        vertex_normals[face.b] = vec3_add(vertex_normals[face.b], weighted_normal);
+        vertex_normals[face.c] = vec3_add(vertex_normals[face.c], weighted_normal);
+    }
+
+    for (int i = 0; i < num_vertices; i += 1) {
+        // Vertices only used by degenerate faces get any unit normal
+        if (vec3_length(vertex_normals[i]) == 0) vertex_normals[i] = vec3_new(0, 0, -1);
+        vec3_normalize(&vertex_normals[i]);
+    }
+
+    for (int i = 0; i < num_faces; i += 1) {
+        face_t *face = &mesh->faces[i];
+        if (face->a_normal < 0) face->a_normal = base + face->a;
+        if (face->b_normal < 0) face->b_normal = base + face->b;
+        if (face->c_normal < 0) face->c_normal = base + face->c;
+    }
+}
+
+// One face's side of an edge
+typedef struct {
+    int a, b; // vertex indices, a < b
+    int face;
+} half_edge_t;
+
+static int compare_half_edges(const void *p, const void *q) {
+    const half_edge_t *x = p;
+    const half_edge_t *y = q;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    if (x->b != y->b) return x->b < y->b ? -1 : 1;
+    return (x->face > y->face) - (x->face < y->face);
+}
+
+// Find the mesh's unique edges and the faces either side of each, so a
+// wireframe can draw an edge once however many faces share it. Reads the
+// float faces, so it runs before the mesh is compacted.
+void build_mesh_edges(mesh_t *mesh) {
+    int num_faces = array_length(mesh->faces);
+    array_free(mesh->edges);
+    mesh->edges = NULL;
+    if (num_faces == 0) return;
+
+    // Every face's three edges, sorted so the sides of an edge are adjacent
+    half_edge_t *half_edges = malloc(sizeof(half_edge_t) * num_faces * 3);
+    int num_half_edges = 0;
+    for (int i = 0; i < num_faces; i += 1) {
+        int vertices[3] = { mesh->faces[i].a, mesh->faces[i].b, mesh->faces[i].c };
+        for (int j = 0; j < 3; j += 1) {
+            int a = vertices[j];
+            int b = vertices[(j + 1) % 3];
+            // Degenerate faces have edges of no length, which draw nothing
+            if (a == b) continue;
+            half_edges[num_half_edges] = (half_edge_t) {
+                .a = a < b ? a : b,
+                .b = a < b ? b : a,
+                .face = i,
+            };
+            num_half_edges += 1;
+        }
+    }
+    qsort(half_edges, num_half_edges, sizeof(half_edge_t), compare_half_edges);
+
+    // Pair up the faces on each edge. An edge of a non-manifold mesh, with
+    // more than two faces, is listed once per pair.
+    int i = 0;
+    while (i < num_half_edges) {
+        half_edge_t side = half_edges[i];
+        edge_t edge = { .a = side.a, .b = side.b, .face_a = side.face, .face_b = -1 };
+        i += 1;
+        if (i < num_half_edges && half_edges[i].a == side.a && half_edges[i].b == side.b) {
+            edge.face_b = half_edges[i].face;
+            i += 1;
+        }
+        array_push(mesh->edges, edge);
+    }
+
+    free(half_edges);
 }
 
 void load_mesh_png_data(mesh_t *mesh, char *png_filename) {
-    upng_t *png_image = upng_new_from_file(png_filename);
-    if (png_image != NULL) {
-        upng_decode(png_image);
-        if (upng_get_error(png_image) == UPNG_EOK) {
-            mesh->texture = png_image;
+    texture_t *texture = load_png_texture(png_filename);
+    if (texture == NULL) return;
+
+    // Publish the fully converted texture; the render loop may be reading it
+    SDL_AtomicSetPtr((void **)&mesh->texture, texture);
+}
+
+// The mesh's texture, or NULL while it's still being decoded (or if it
+// failed to load)
+texture_t *get_mesh_texture(mesh_t *mesh) {
+    return SDL_AtomicGetPtr((void **)&mesh->texture);
+}
+
+void wait_mesh_textures(void) {
+    wait_job_group(&texture_jobs);
+}
+
+// Convert a mesh's vertices and faces to compact storage (see quantize.h),
+// freeing the float arrays. Returns false, leaving the mesh untouched, if the
+// mesh doesn't fit the compact layout.
+bool mesh_compact(mesh_t *mesh) {
+    int num_vertices = array_length(mesh->vertices);
+    int num_faces = array_length(mesh->faces);
+    int num_normals = array_length(mesh->normals);
+
+    // Compact faces use 16-bit vertex and normal indices and share a single
+    // color
+    if (num_vertices == 0 || num_vertices > QUANTIZE_MAX + 1) return false;
+    if (num_normals > QUANTIZE_MAX + 1) return false;
+    for (int i = 0; i < num_faces; i += 1) {
+        if (mesh->faces[i].color != mesh->faces[0].color) return false;
+    }
+
+    // Find the bounding box of the positions
+    vec3_t min = mesh->vertices[0];
+    vec3_t max = mesh->vertices[0];
+    for (int i = 1; i < num_vertices; i += 1) {
+        vec3_t v = mesh->vertices[i];
+        if (v.x < min.x) min.x = v.x;
+        if (v.y < min.y) min.y = v.y;
+        if (v.z < min.z) min.z = v.z;
+        if (v.x > max.x) max.x = v.x;
+        if (v.y > max.y) max.y = v.y;
+        if (v.z > max.z) max.z = v.z;
+    }
+    vec3_t extent = vec3_sub(max, min);
+
+    // Find the range of the texture coordinates
+    tex2_t uv_min = num_faces > 0 ? mesh->faces[0].a_uv : (tex2_t) { 0, 0 };
+    tex2_t uv_max = uv_min;
+    for (int i = 0; i < num_faces; i += 1) {
+        tex2_t uvs[3] = { mesh->faces[i].a_uv, mesh->faces[i].b_uv, mesh->faces[i].c_uv };
+        for (int j = 0; j < 3; j += 1) {
+            if (uvs[j].u < uv_min.u) uv_min.u = uvs[j].u;
+            if (uvs[j].v < uv_min.v) uv_min.v = uvs[j].v;
+            if (uvs[j].u > uv_max.u) uv_max.u = uvs[j].u;
+            if (uvs[j].v > uv_max.v) uv_max.v = uvs[j].v;
         }
     }
+    tex2_t uv_extent = { uv_max.u - uv_min.u, uv_max.v - uv_min.v };
+
+    compact_mesh_t compact = {
+        .vertices = array_hold(NULL, num_vertices, sizeof(qvec3_t)),
+        .faces = num_faces > 0 ? array_hold(NULL, num_faces, sizeof(qface_t)) : NULL,
+        .normals = num_normals > 0 ? array_hold(NULL, num_normals, sizeof(qnormal_t)) : NULL,
+        .position_min = min,
+        .position_step = vec3_new(quantize_step(extent.x), quantize_step(extent.y), quantize_step(extent.z)),
+        .uv_min = uv_min,
+        .uv_step = { quantize_step(uv_extent.u), quantize_step(uv_extent.v) },
+        .color = num_faces > 0 ? mesh->faces[0].color : 0xFFFFFFFF,
+    };
+
+    for (int i = 0; i < num_vertices; i += 1) {
+        compact.vertices[i] = qvec3_encode(mesh->vertices[i], min, extent);
+    }
+
+    for (int i = 0; i < num_faces; i += 1) {
+        face_t face = mesh->faces[i];
+        compact.faces[i] = (qface_t) {
+            .a = face.a,
+            .b = face.b,
+            .c = face.c,
+            .a_uv = qtex2_encode(face.a_uv, uv_min, uv_extent),
+            .b_uv = qtex2_encode(face.b_uv, uv_min, uv_extent),
+            .c_uv = qtex2_encode(face.c_uv, uv_min, uv_extent),
+            .a_normal = face.a_normal,
+            .b_normal = face.b_normal,
+            .c_normal = face.c_normal,
+        };
+    }
+
+    for (int i = 0; i < num_normals; i += 1) {
+        compact.normals[i] = qnormal_encode(mesh->normals[i]);
+    }
+
+    array_free(mesh->normals);
+    array_free(mesh->faces);
+    array_free(mesh->vertices);
+    mesh->normals = NULL;
+    mesh->faces = NULL;
+    mesh->vertices = NULL;
+    mesh->compact = compact;
+
+    return true;
+}
+
+bool is_mesh_compact(mesh_t *mesh) {
+    return mesh->compact.vertices != NULL;
+}
+
+int get_mesh_num_faces(mesh_t *mesh) {
+    if (is_mesh_compact(mesh)) return array_length(mesh->compact.faces);
+    return array_length(mesh->faces);
+}
+
+int get_mesh_num_vertices(mesh_t *mesh) {
+    if (is_mesh_compact(mesh)) return array_length(mesh->compact.vertices);
+    return array_length(mesh->vertices);
+}
+
+int get_mesh_num_normals(mesh_t *mesh) {
+    if (is_mesh_compact(mesh)) return array_length(mesh->compact.normals);
+    return array_length(mesh->normals);
+}
+
+// A mesh's unit normal, in either storage
+vec3_t get_mesh_normal(mesh_t *mesh, int index) {
+    if (is_mesh_compact(mesh)) return qnormal_decode(mesh->compact.normals[index]);
+    return mesh->normals[index];
 }
 
 int get_num_meshes(void) {
@@ -180,9 +503,16 @@ mesh_t *get_mesh(int index) {
 }
 
 void free_meshes(void) {
+    wait_mesh_textures();
+
     for (int i = 0; i < mesh_count; i += 1) {
-        upng_free(meshes[i].texture);
+        free_texture(meshes[i].texture);
+        array_free(meshes[i].edges);
+        array_free(meshes[i].normals);
         array_free(meshes[i].faces);
         array_free(meshes[i].vertices);
+        array_free(meshes[i].compact.normals);
+        array_free(meshes[i].compact.faces);
+        array_free(meshes[i].compact.vertices);
     }
 }
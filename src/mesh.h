@@ -1,23 +1,63 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "vector.h"
 #include "triangle.h"
-#include "upng.h"
+#include "texture.h"
+#include "quantize.h"
+
+#define MAX_NUMBER_MESHES 10
+
+// Compact storage for a mesh (see quantize.h for the precision bounds)
+typedef struct {
+    qvec3_t *vertices;    // dynamic array of quantized vertices
+    qface_t *faces;       // dynamic array of quantized faces
+    qnormal_t *normals;   // dynamic array of octahedral normals
+    vec3_t position_min;  // bounding box origin
+    vec3_t position_step; // bounding box extent / QUANTIZE_MAX
+    tex2_t uv_min;        // UV range origin
+    tex2_t uv_step;       // UV range extent / QUANTIZE_MAX
+    uint32_t color;       // color shared by all faces
+} compact_mesh_t;
+
+// An edge between two of a mesh's vertices and the faces either side of it
+typedef struct {
+    int a, b;   // vertex indices, a < b
+    int face_a; // first face using the edge
+    int face_b; // second face, or -1 on the border of an open mesh
+} edge_t;
 
 // Dynamically sized mesh
 typedef struct {
-    vec3_t *vertices;   // dynamic array of vertices
-    face_t *faces;      // dynamic array of faces
-    upng_t *texture;    // PNG texture pointer
-    vec3_t rotation;    // rotation with x, y, and z values
-    vec3_t scale;       // scale with x, y, z
-    vec3_t translation; // translation with x, y, and z values
+    vec3_t *vertices;       // dynamic array of vertices (NULL if compact)
+    face_t *faces;          // dynamic array of faces (NULL if compact)
+    vec3_t *normals;        // dynamic array of unit normals (NULL if compact)
+    edge_t *edges;          // dynamic array of unique edges, in either storage
+    compact_mesh_t compact; // quantized vertices and faces (if compact)
+    texture_t *texture;     // texture (NULL until decoded)
+    vec3_t rotation;        // rotation with x, y, and z values
+    vec3_t scale;           // scale with x, y, z
+    vec3_t translation;     // translation with x, y, and z values
 } mesh_t;
 
 
 void load_mesh(char *obj_filename, char *png_filename, vec3_t scale, vec3_t translation, vec3_t rotation);
 void load_mesh_obj_data(mesh_t *mesh, char *obj_filename);
 void load_mesh_png_data(mesh_t *mesh, char *png_filename);
+void build_mesh_normals(mesh_t *mesh);
+void build_mesh_edges(mesh_t *mesh);
+texture_t *get_mesh_texture(mesh_t *mesh);
+void wait_mesh_textures(void);
+bool get_compact_meshes(void);
+void set_compact_meshes(bool setting);
+bool mesh_compact(mesh_t *mesh);
+bool is_mesh_compact(mesh_t *mesh);
+int get_mesh_num_faces(mesh_t *mesh);
+int get_mesh_num_vertices(mesh_t *mesh);
+int get_mesh_num_normals(mesh_t *mesh);
+vec3_t get_mesh_normal(mesh_t *mesh, int index);
 int get_num_meshes(void);
 mesh_t *get_mesh(int index);
 void free_meshes(void);
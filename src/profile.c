@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "profile.h"
+#include "trace.h"
+
+static const char *stage_names[NUM_PROFILE_STAGES] = {
+    "input",
+    "update",
+    "transform",
+    "cull",
+    "clip",
+    "project",
+    "clear",
+    "rasterize",
+    "debug_view",
+    "hud",
+    "present",
+};
+
+static bool profiling = false;
+
+static uint64_t frame_start = 0;
+static uint64_t previous_frame_start = 0;
+static uint64_t stage_start[NUM_PROFILE_STAGES];
+static uint64_t stage_elapsed[NUM_PROFILE_STAGES];
+
+// Counter readings at the first profiled frame, to calibrate the ticks
+static uint64_t calibration_ticks = 0;
+static uint64_t calibration_counter = 0;
+static double ticks_per_ms = 0;
+
+// Ring buffer of recently profiled frames
+static profile_frame_t history[PROFILE_HISTORY];
+static int history_next = 0;
+static int history_length = 0;
+
+// The time stamp counter is several times cheaper to read than the OS clock,
+// which matters when timing every face
+static uint64_t read_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+// Frames and stages also go to the trace when tracing, whether profiling or
+// not, except the parts of update: those switch per face, far too often
+static bool is_traced_stage(int stage) {
+    return stage < STAGE_TRANSFORM || stage > STAGE_PROJECT;
+}
+
+void trace_stage_begin(int stage) {
+    if (is_traced_stage(stage)) TRACE_BEGIN(stage_names[stage]);
+}
+
+void trace_stage_end(int stage) {
+    if (is_traced_stage(stage)) TRACE_END(stage_names[stage]);
+}
+
+bool get_profiling(void) {
+    return profiling;
+}
+
+void set_profiling(bool setting) {
+    profiling = setting;
+}
+
+void profile_begin_frame(void) {
+    TRACE_BEGIN("frame");
+    if (!profiling) return;
+
+    for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+        stage_elapsed[i] = 0;
+    }
+    frame_start = read_ticks();
+
+    if (calibration_counter == 0) {
+        calibration_ticks = frame_start;
+        calibration_counter = SDL_GetPerformanceCounter();
+    }
+}
+
+void profile_end_frame(void) {
+    TRACE_END("frame");
+    if (!profiling) return;
+
+    uint64_t now = read_ticks();
+
+    // Refine the tick rate over everything profiled so far
+    double elapsed_ms = (SDL_GetPerformanceCounter() - calibration_counter) * 1000.0 / SDL_GetPerformanceFrequency();
+    if (elapsed_ms > 0) {
+        ticks_per_ms = (now - calibration_ticks) / elapsed_ms;
+    }
+    if (ticks_per_ms <= 0) return;
+
+    profile_frame_t *frame = &history[history_next];
+    frame->frame_ms = (now - frame_start) / ticks_per_ms;
+    frame->interval_ms = previous_frame_start ? (frame_start - previous_frame_start) / ticks_per_ms : frame->frame_ms;
+    previous_frame_start = frame_start;
+    for (int i = 0; i < NUM_PROFILE_STAGES; i += 1) {
+        frame->stage_ms[i] = stage_elapsed[i] / ticks_per_ms;
+    }
+
+    history_next = (history_next + 1) % PROFILE_HISTORY;
+    if (history_length < PROFILE_HISTORY) history_length += 1;
+}
+
+void profile_begin(int stage) {
+    trace_stage_begin(stage);
+    if (!profiling) return;
+    stage_start[stage] = read_ticks();
+}
+
+void profile_end(int stage) {
+    trace_stage_end(stage);
+    if (!profiling) return;
+    stage_elapsed[stage] += read_ticks() - stage_start[stage];
+}
+
+// End one stage and begin another with a single counter read
+void profile_switch(int from, int to) {
+    if (!profiling) return;
+    uint64_t now = read_ticks();
+    stage_elapsed[from] += now - stage_start[from];
+    stage_start[to] = now;
+}
+
+double get_profile_frame_ms(void) {
+    return history_length > 0 ? get_profile_history(0)->frame_ms : 0;
+}
+
+double get_profile_stage_ms(int stage) {
+    return history_length > 0 ? get_profile_history(0)->stage_ms[stage] : 0;
+}
+
+int get_profile_history_length(void) {
+    return history_length;
+}
+
+// A profiled frame by age, 0 being the last one
+const profile_frame_t *get_profile_history(int age) {
+    int index = (history_next - 1 - age + PROFILE_HISTORY) % PROFILE_HISTORY;
+    return &history[index];
+}
+
+const char *get_profile_stage_name(int stage) {
+    return stage_names[stage];
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include "trace.h"
+
+// Per-stage frame profiler
+//
+// Stages are timed with a cheap high resolution counter (the CPU's time
+// stamp counter where there is one, calibrated against SDL's performance
+// counter). A stage may be entered several times in a frame and its times
+// add up; transform, cull, clip and project are the parts of update spent
+// in the face loop (with pipelined frames they run on a worker instead,
+// alongside the rest of the frame, and time the next frame's faces). The
+// last PROFILE_HISTORY frames are kept for the HUD.
+//
+// Nothing is timed unless profiling is enabled at runtime, and building
+// with -DPROFILER=0 compiles the timers out entirely. While tracing (see
+// trace.h), frames and stages outside the face loop are traced as well,
+// with or without the profiler compiled in.
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#define PROFILE_HISTORY 128
+
+enum profile_stage {
+    STAGE_INPUT,
+    STAGE_UPDATE,
+    STAGE_TRANSFORM,
+    STAGE_CULL,
+    STAGE_CLIP,
+    STAGE_PROJECT,
+    STAGE_CLEAR,
+    STAGE_RASTERIZE,
+    STAGE_DEBUG_VIEW,
+    STAGE_HUD,
+    STAGE_PRESENT,
+    NUM_PROFILE_STAGES
+};
+
+typedef struct {
+    double frame_ms;        // time spent producing the frame
+    double interval_ms;     // time since the previous frame began
+    double stage_ms[NUM_PROFILE_STAGES];
+} profile_frame_t;
+
+#if PROFILER
+#define PROFILE_BEGIN_FRAME() profile_begin_frame()
+#define PROFILE_END_FRAME() profile_end_frame()
+#define PROFILE_BEGIN(stage) profile_begin(stage)
+#define PROFILE_END(stage) profile_end(stage)
+#define PROFILE_SWITCH(from, to) profile_switch(from, to)
+#elif TRACER
+// Without the profiler, frames and stages still go to the trace
+#define PROFILE_BEGIN_FRAME() TRACE_BEGIN("frame")
+#define PROFILE_END_FRAME() TRACE_END("frame")
+#define PROFILE_BEGIN(stage) trace_stage_begin(stage)
+#define PROFILE_END(stage) trace_stage_end(stage)
+#define PROFILE_SWITCH(from, to) ((void)0)
+#else
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+#define PROFILE_BEGIN(stage) ((void)0)
+#define PROFILE_END(stage) ((void)0)
+#define PROFILE_SWITCH(from, to) ((void)0)
+#endif
+
+bool get_profiling(void);
+void set_profiling(bool setting);
+void profile_begin_frame(void);
+void profile_end_frame(void);
+void profile_begin(int stage);
+void profile_end(int stage);
+void profile_switch(int from, int to);
+void trace_stage_begin(int stage);
+void trace_stage_end(int stage);
+double get_profile_frame_ms(void);
+double get_profile_stage_ms(int stage);
+int get_profile_history_length(void);
+const profile_frame_t *get_profile_history(int age);
+const char *get_profile_stage_name(int stage);
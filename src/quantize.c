@@ -0,0 +1,99 @@
+#include <math.h>
+
+#include "quantize.h"
+
+uint16_t quantize_unorm16(float value, float min, float extent) {
+    // A flat range (e.g. a planar mesh) has nothing to encode
+    if (extent <= 0) return 0;
+
+    float t = (value - min) / extent;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+
+    // Round to nearest, which is what bounds the error to half a step
+    return (uint16_t)(t * QUANTIZE_MAX + 0.5f);
+}
+
+float dequantize_unorm16(uint16_t q, float min, float step) {
+    return min + q * step;
+}
+
+float quantize_step(float extent) {
+    return extent / QUANTIZE_MAX;
+}
+
+qvec3_t qvec3_encode(vec3_t v, vec3_t min, vec3_t extent) {
+    return (qvec3_t) {
+        .x = quantize_unorm16(v.x, min.x, extent.x),
+        .y = quantize_unorm16(v.y, min.y, extent.y),
+        .z = quantize_unorm16(v.z, min.z, extent.z),
+    };
+}
+
+vec3_t qvec3_decode(qvec3_t q, vec3_t min, vec3_t step) {
+    return (vec3_t) {
+        .x = dequantize_unorm16(q.x, min.x, step.x),
+        .y = dequantize_unorm16(q.y, min.y, step.y),
+        .z = dequantize_unorm16(q.z, min.z, step.z),
+    };
+}
+
+// Raw integer coordinates as floats, for when the decode is folded into a
+// matrix (see process_graphics_pipeline_stages)
+vec3_t qvec3_to_vec3(qvec3_t q) {
+    return (vec3_t) { q.x, q.y, q.z };
+}
+
+qtex2_t qtex2_encode(tex2_t t, tex2_t min, tex2_t extent) {
+    return (qtex2_t) {
+        .u = quantize_unorm16(t.u, min.u, extent.u),
+        .v = quantize_unorm16(t.v, min.v, extent.v),
+    };
+}
+
+tex2_t qtex2_decode(qtex2_t q, tex2_t min, tex2_t step) {
+    return (tex2_t) {
+        .u = dequantize_unorm16(q.u, min.u, step.u),
+        .v = dequantize_unorm16(q.v, min.v, step.v),
+    };
+}
+
+#define SNORM16_MAX 32767
+
+static float sign_not_zero(float value) {
+    return value >= 0 ? 1 : -1;
+}
+
+static int16_t quantize_snorm16(float value) {
+    if (value < -1) value = -1;
+    if (value > 1) value = 1;
+    return (int16_t)lroundf(value * SNORM16_MAX);
+}
+
+qnormal_t qnormal_encode(vec3_t n) {
+    // Project onto the octahedron, then fold the lower half (z < 0) out over
+    // the corners of the square
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 == 0) return (qnormal_t) { 0, 0 };
+    float x = n.x / l1;
+    float y = n.y / l1;
+    if (n.z < 0) {
+        float folded_x = (1 - fabsf(y)) * sign_not_zero(x);
+        float folded_y = (1 - fabsf(x)) * sign_not_zero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+    return (qnormal_t) { quantize_snorm16(x), quantize_snorm16(y) };
+}
+
+vec3_t qnormal_decode(qnormal_t q) {
+    float x = (float)q.x / SNORM16_MAX;
+    float y = (float)q.y / SNORM16_MAX;
+    vec3_t n = { x, y, 1 - fabsf(x) - fabsf(y) };
+    if (n.z < 0) {
+        n.x = (1 - fabsf(y)) * sign_not_zero(x);
+        n.y = (1 - fabsf(x)) * sign_not_zero(y);
+    }
+    vec3_normalize(&n);
+    return n;
+}
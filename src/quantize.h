@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include "vector.h"
+#include "texture.h"
+
+// Compact (quantized) vertex attributes
+//
+// Each component is stored as a 16-bit unsigned integer normalized to a
+// range [min, min + extent] known for the whole mesh: positions use the
+// mesh's bounding box, texture coordinates use the range of its UVs (they
+// aren't guaranteed to stay within [0, 1]).
+//
+// Precision: quantization rounds to the nearest of 65536 evenly spaced
+// steps, so a decoded component is off by at most half a step (plus float
+// rounding in the decode), i.e.
+//     |error| <= extent / (2 * 65535)
+// per axis. For a model spanning 10 units that's ~0.00008 units, and for
+// UVs in [0, 1] it's well below a texel even for 4096px wide textures.
+//
+// Together with 16-bit indices this cuts the resident size of a mesh's
+// vertices and faces a little over 2x (e.g. drone.obj 453KB -> 209KB,
+// nefertiti.obj 4.6MB -> 2.1MB).
+
+#define QUANTIZE_MAX 65535
+
+typedef struct {
+    uint16_t x, y, z;
+} qvec3_t;
+
+typedef struct {
+    uint16_t u, v;
+} qtex2_t;
+
+// A unit normal in octahedral encoding: projected onto the octahedron
+// |x| + |y| + |z| = 1, with the lower half folded over the upper, and the
+// resulting square stored as two signed 16-bit components. That's a third of
+// the size of three floats, and decodes within a few thousandths of a
+// degree of the original direction.
+typedef struct {
+    int16_t x, y;
+} qnormal_t;
+
+// A face using 16-bit vertex (and normal) indices, meaning the mesh can have
+// at most 65536 of each. Faces share a single color in compact storage.
+typedef struct {
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+    qtex2_t a_uv;
+    qtex2_t b_uv;
+    qtex2_t c_uv;
+    uint16_t a_normal;
+    uint16_t b_normal;
+    uint16_t c_normal;
+} qface_t;
+
+uint16_t quantize_unorm16(float value, float min, float extent);
+float dequantize_unorm16(uint16_t q, float min, float step);
+float quantize_step(float extent);
+
+qvec3_t qvec3_encode(vec3_t v, vec3_t min, vec3_t extent);
+vec3_t qvec3_decode(qvec3_t q, vec3_t min, vec3_t step);
+vec3_t qvec3_to_vec3(qvec3_t q);
+qtex2_t qtex2_encode(tex2_t t, tex2_t min, tex2_t extent);
+tex2_t qtex2_decode(qtex2_t q, tex2_t min, tex2_t step);
+qnormal_t qnormal_encode(vec3_t n);
+vec3_t qnormal_decode(qnormal_t q);
@@ -0,0 +1,67 @@
+#include <SDL2/SDL.h>
+
+#include "scheduler.h"
+#include "display.h"
+
+#define NS_PER_SECOND 1000000000ull
+#define FRAME_PERIOD_NS (NS_PER_SECOND / FPS)
+
+// Sleeping can overshoot by a millisecond or two (the OS's timer slack and
+// scheduling), so the last stretch of a wait spins instead
+#define SPIN_NS 2000000ull
+
+static bool uncapped = false;
+
+static uint64_t next_frame_ns = 0;
+static uint64_t previous_frame_ns = 0;
+
+// Nanoseconds on a monotonic clock since some unspecified start
+uint64_t get_time_ns(void) {
+    static uint64_t frequency = 0;
+    if (frequency == 0) frequency = SDL_GetPerformanceFrequency();
+
+    // Split the conversion so the multiplication can't overflow
+    uint64_t counter = SDL_GetPerformanceCounter();
+    return counter / frequency * NS_PER_SECOND + counter % frequency * NS_PER_SECOND / frequency;
+}
+
+void sleep_until_ns(uint64_t deadline) {
+    uint64_t now = get_time_ns();
+    if (now + SPIN_NS < deadline) {
+        SDL_Delay((deadline - now - SPIN_NS) / 1000000);
+    }
+    while (get_time_ns() < deadline) {
+        // Spin
+    }
+}
+
+bool get_uncapped(void) {
+    return uncapped;
+}
+
+void set_uncapped(bool setting) {
+    uncapped = setting;
+}
+
+// Wait until the next frame is due and return the seconds since the
+// previous frame began (one period for the first frame)
+double wait_for_frame(void) {
+    if (!uncapped) {
+        uint64_t now = get_time_ns();
+
+        // A frame more than a whole period late starts the grid over, rather
+        // than rushing the next few frames to catch up
+        if (next_frame_ns == 0 || now > next_frame_ns + FRAME_PERIOD_NS) {
+            next_frame_ns = now;
+        }
+        sleep_until_ns(next_frame_ns);
+        next_frame_ns += FRAME_PERIOD_NS;
+    }
+
+    uint64_t now = get_time_ns();
+    double elapsed = previous_frame_ns
+        ? (double)(now - previous_frame_ns) / NS_PER_SECOND
+        : 1.0 / FPS;
+    previous_frame_ns = now;
+    return elapsed;
+}
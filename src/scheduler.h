@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frame scheduler
+//
+// Paces frames against a monotonic nanosecond clock. Frames are due on a
+// fixed grid of FPS per second, so one running a little long doesn't delay
+// the rest; the wait sleeps for most of the time left and spins for the
+// last stretch, which sleeping would overshoot. Uncapped, frames start as
+// soon as the previous one is done.
+
+uint64_t get_time_ns(void);
+void sleep_until_ns(uint64_t deadline);
+bool get_uncapped(void);
+void set_uncapped(bool setting);
+double wait_for_frame(void);
@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "stats.h"
+#include "jobs.h"
+
+static const char *stat_names[NUM_PIPELINE_STATS] = {
+    "faces_in",
+    "faces_culled",
+    "faces_rejected",
+    "faces_clipped",
+    "triangles_emitted",
+    "pixels_covered",
+    "depth_passed",
+    "depth_failed",
+    "texels_fetched",
+};
+
+// Padded to keep each thread's counters on their own cache lines
+typedef union {
+    pipeline_stats_t stats;
+    char padding[128];
+} thread_stats_t;
+
+static thread_stats_t thread_stats[MAX_THREADS];
+static pipeline_stats_t frame_stats;
+
+// The calling thread's counters for the current frame
+pipeline_stats_t *get_thread_stats(void) {
+    return &thread_stats[get_thread_index()].stats;
+}
+
+void begin_stats_frame(void) {
+    memset(thread_stats, 0, sizeof(thread_stats));
+}
+
+// Sum every thread's counters; call once no work for the frame is in flight
+void end_stats_frame(void) {
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    uint64_t *total = (uint64_t *)&frame_stats;
+    for (int t = 0; t < MAX_THREADS; t += 1) {
+        const uint64_t *counters = (const uint64_t *)&thread_stats[t].stats;
+        for (int i = 0; i < (int)NUM_PIPELINE_STATS; i += 1) {
+            total[i] += counters[i];
+        }
+    }
+}
+
+// Totals of the last complete frame
+pipeline_stats_t get_frame_stats(void) {
+    return frame_stats;
+}
+
+// Counters by index, in declaration order, for reporting them generically
+uint64_t get_pipeline_stat(const pipeline_stats_t *stats, int index) {
+    return ((const uint64_t *)stats)[index];
+}
+
+const char *get_pipeline_stat_name(int index) {
+    return stat_names[index];
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// Pipeline statistics
+//
+// Each thread counts into its own block (see get_thread_stats), so counting
+// never contends. Blocks are summed once a frame is done.
+typedef struct {
+    // Geometry, from the face loop and the clipper
+    uint64_t faces_in;
+    uint64_t faces_culled;       // backfaces
+    uint64_t faces_rejected;     // entirely outside the frustum
+    uint64_t faces_clipped;      // cut by at least one frustum plane
+    uint64_t triangles_emitted;  // by triangles_from_polygon
+    // Raster, from the rasterizer
+    uint64_t pixels_covered;
+    uint64_t depth_passed;
+    uint64_t depth_failed;
+    uint64_t texels_fetched;
+} pipeline_stats_t;
+
+#define NUM_PIPELINE_STATS (sizeof(pipeline_stats_t) / sizeof(uint64_t))
+
+pipeline_stats_t *get_thread_stats(void);
+void begin_stats_frame(void);
+void end_stats_frame(void);
+pipeline_stats_t get_frame_stats(void);
+uint64_t get_pipeline_stat(const pipeline_stats_t *stats, int index);
+const char *get_pipeline_stat_name(int index);
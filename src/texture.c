@@ -1,5 +1,152 @@
+#include <stdio.h>
+#include <SDL2/SDL.h>
+
 #include "texture.h"
+#include "trace.h"
 
 tex2_t tex2_clone(tex2_t *t) {
     return (tex2_t) { t->u, t->v };
 }
+
+static uint32_t argb(uint32_t a, uint32_t r, uint32_t g, uint32_t b) {
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// The index-th sample of a buffer packing samples of the given bit depth
+// (1, 2, 4, 8 or 16) MSB first, with 16-bit samples truncated to 8 bits
+static uint32_t png_sample(const unsigned char *buffer, unsigned long index, unsigned depth) {
+    if (depth == 8) return buffer[index];
+    if (depth == 16) return buffer[index * 2];
+
+    unsigned long bit = index * depth;
+    unsigned shift = 8 - depth - bit % 8;
+    return (buffer[bit / 8] >> shift) & ((1u << depth) - 1);
+}
+
+// Scale a sample of less than 8 bits to the full 0-255 range
+static uint32_t png_sample_unorm8(const unsigned char *buffer, unsigned long index, unsigned depth) {
+    uint32_t sample = png_sample(buffer, index, depth);
+    if (depth >= 8) return sample;
+    return sample * 255 / ((1u << depth) - 1);
+}
+
+// Convert a decoded PNG, in any of upng's formats, to a texture
+texture_t *texture_from_png(const upng_t *png) {
+    int width = upng_get_width(png);
+    int height = upng_get_height(png);
+    const unsigned char *buffer = upng_get_buffer(png);
+    unsigned depth = upng_get_bitdepth(png);
+
+    texture_t *texture = malloc(sizeof(texture_t));
+    if (!texture) return NULL;
+    texture->width = width;
+    texture->height = height;
+    texture->texels = SDL_SIMDAlloc(sizeof(uint32_t) * width * height);
+    if (!texture->texels) {
+        free(texture);
+        return NULL;
+    }
+
+    unsigned long num_texels = (unsigned long)width * height;
+    uint32_t *texels = texture->texels;
+
+    switch (upng_get_format(png)) {
+    // The formats our assets actually use get a straight loop
+    case UPNG_RGBA8:
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            const unsigned char *p = buffer + i * 4;
+            texels[i] = argb(p[3], p[0], p[1], p[2]);
+        }
+        break;
+    case UPNG_RGB8:
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            const unsigned char *p = buffer + i * 3;
+            texels[i] = argb(0xFF, p[0], p[1], p[2]);
+        }
+        break;
+    case UPNG_RGBA16:
+    case UPNG_RGB16: {
+        unsigned components = upng_get_components(png);
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            unsigned long s = i * components;
+            uint32_t a = components == 4 ? png_sample(buffer, s + 3, 16) : 0xFF;
+            texels[i] = argb(a, png_sample(buffer, s, 16), png_sample(buffer, s + 1, 16), png_sample(buffer, s + 2, 16));
+        }
+        break;
+    }
+    case UPNG_LUMINANCE1:
+    case UPNG_LUMINANCE2:
+    case UPNG_LUMINANCE4:
+    case UPNG_LUMINANCE8:
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            uint32_t l = png_sample_unorm8(buffer, i, depth);
+            texels[i] = argb(0xFF, l, l, l);
+        }
+        break;
+    case UPNG_LUMINANCE_ALPHA1:
+    case UPNG_LUMINANCE_ALPHA2:
+    case UPNG_LUMINANCE_ALPHA4:
+    case UPNG_LUMINANCE_ALPHA8:
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            uint32_t l = png_sample_unorm8(buffer, i * 2, depth);
+            uint32_t a = png_sample_unorm8(buffer, i * 2 + 1, depth);
+            texels[i] = argb(a, l, l, l);
+        }
+        break;
+    case UPNG_PALETTE1:
+    case UPNG_PALETTE2:
+    case UPNG_PALETTE4:
+    case UPNG_PALETTE8: {
+        unsigned palette_size;
+        const unsigned char *palette = upng_get_palette(png, &palette_size);
+        for (unsigned long i = 0; i < num_texels; i += 1) {
+            uint32_t index = png_sample(buffer, i, depth);
+            if (index < palette_size) {
+                const unsigned char *p = palette + index * 4;
+                texels[i] = argb(p[3], p[0], p[1], p[2]);
+            } else {
+                texels[i] = argb(0xFF, 0, 0, 0);
+            }
+        }
+        break;
+    }
+    default:
+        free_texture(texture);
+        return NULL;
+    }
+
+    return texture;
+}
+
+// Decode a PNG file into a texture, releasing the decoded image (and the
+// file contents upng keeps until it's decoded) once converted
+texture_t *load_png_texture(const char *filename) {
+    upng_t *png = upng_new_from_file(filename);
+    if (png == NULL) return NULL;
+
+#if TRACER
+    upng_set_trace(png, trace_begin, trace_end);
+#endif
+    upng_decode(png);
+    if (upng_get_error(png) != UPNG_EOK) {
+        fprintf(stderr, "Error loading texture %s.\n", filename);
+        upng_free(png);
+        return NULL;
+    }
+
+    TRACE_BEGIN("texture_convert");
+    texture_t *texture = texture_from_png(png);
+    TRACE_END("texture_convert");
+    if (!texture) {
+        fprintf(stderr, "Error converting texture %s.\n", filename);
+    }
+    upng_free(png);
+
+    return texture;
+}
+
+void free_texture(texture_t *texture) {
+    if (!texture) return;
+    SDL_SIMDFree(texture->texels);
+    free(texture);
+}
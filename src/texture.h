@@ -1,8 +1,24 @@
 #pragma once
 
+#include <stdint.h>
+#include "upng.h"
+
 typedef struct {
     float u;
     float v;
 } tex2_t;
 
+// A texture in the color buffer's layout: 32-bit ARGB texels (0xAARRGGBB),
+// row-major with no padding, in a buffer aligned for SIMD loads. Whatever
+// format the source image was in, this is all the sampler ever sees.
+typedef struct {
+    int width;
+    int height;
+    uint32_t *texels;
+} texture_t;
+
 tex2_t tex2_clone(tex2_t *t);
+
+texture_t *texture_from_png(const upng_t *png);
+texture_t *load_png_texture(const char *filename);
+void free_texture(texture_t *texture);
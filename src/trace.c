@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "trace.h"
+#include "array.h"
+#include "jobs.h"
+
+// Stop recording on a thread past this many events (24MB), rather than
+// growing without bound in long runs
+#define MAX_TRACE_EVENTS (1 << 20)
+
+typedef struct {
+    const char *name;
+    uint64_t counter;   // SDL_GetPerformanceCounter() at the event
+    char phase;         // 'B' or 'E', as in the trace-event format
+} trace_event_t;
+
+// A thread's events, and how many it had to drop
+typedef struct {
+    trace_event_t *events;
+    int dropped;
+} trace_buffer_t;
+
+// Padded so threads appending to their own buffers don't share cache lines
+typedef union {
+    trace_buffer_t buffer;
+    char padding[128];
+} thread_trace_t;
+
+static bool tracing = false;
+static uint64_t trace_start = 0;
+static thread_trace_t buffers[MAX_THREADS];
+
+bool get_tracing(void) {
+    return tracing;
+}
+
+void set_tracing(bool setting) {
+    if (setting && trace_start == 0) trace_start = SDL_GetPerformanceCounter();
+    tracing = setting;
+}
+
+static void record(const char *name, char phase) {
+    trace_buffer_t *buffer = &buffers[get_thread_index()].buffer;
+    if (array_length(buffer->events) >= MAX_TRACE_EVENTS) {
+        buffer->dropped += 1;
+        return;
+    }
+
+    trace_event_t event = { name, SDL_GetPerformanceCounter(), phase };
+    array_push(buffer->events, event);
+}
+
+void trace_begin(const char *name) {
+    if (!tracing) return;
+    record(name, 'B');
+}
+
+void trace_end(const char *name) {
+    if (!tracing) return;
+    record(name, 'E');
+}
+
+// Write every thread's events as trace-event JSON; call once no other thread
+// is recording (e.g. after free_jobs)
+bool write_trace(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening %s for writing.\n", filename);
+        return false;
+    }
+
+    double us_per_count = 1000000.0 / SDL_GetPerformanceFrequency();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (int t = 0; t < MAX_THREADS; t += 1) {
+        trace_buffer_t *buffer = &buffers[t].buffer;
+        int num_events = array_length(buffer->events);
+        if (num_events == 0) continue;
+
+        // Name the thread's track
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+            first ? "" : ",\n", t, t == 0 ? "main" : "worker", t);
+        first = false;
+
+        for (int i = 0; i < num_events; i += 1) {
+            trace_event_t *event = &buffer->events[i];
+            double ts = (double)(event->counter - trace_start) * us_per_count;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                event->name, event->phase, ts, t);
+        }
+
+        if (buffer->dropped > 0) {
+            fprintf(stderr, "Trace dropped %d events on thread %d.\n", buffer->dropped, t);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+void free_trace(void) {
+    for (int t = 0; t < MAX_THREADS; t += 1) {
+        array_free(buffers[t].buffer.events);
+        buffers[t].buffer.events = NULL;
+        buffers[t].buffer.dropped = 0;
+    }
+}
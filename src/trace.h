@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Timeline tracing
+//
+// Records begin/end events into one buffer per thread (see
+// get_thread_index), so recording takes no locks: each buffer only ever has
+// its own thread writing to it. At exit the buffers are written out as a
+// Chrome trace-event JSON file, which chrome://tracing and Perfetto open.
+//
+// Event names must be string literals (or otherwise outlive the trace), as
+// only the pointer is recorded.
+
+#ifndef TRACER
+#define TRACER 1
+#endif
+
+#if TRACER
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END(name) trace_end(name)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#endif
+
+bool get_tracing(void);
+void set_tracing(bool setting);
+void trace_begin(const char *name);
+void trace_end(const char *name);
+bool write_trace(const char *filename);
+void free_trace(void);
@@ -1,7 +1,10 @@
+#include <stdio.h>
 #include <math.h>
 #include "display.h"
 #include "triangle.h"
 #include "swap.h"
+#include "stats.h"
+#include "light.h"
 
 vec3_t get_triangle_normal(vec4_t transformed_vertices[3]) {
     // Something I didn't realize earlier but is worth stating explicity:
@@ -54,60 +57,334 @@ vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p) {
     return weights;
 }
 
-void draw_solid_pixel(
-    int x, int y, uint32_t color,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c
-) {
+// Per-triangle values the span functions interpolate between, with the
+// divisions by w done once per triangle instead of per pixel
+typedef struct {
+    vec2_t a, b, c;             // screen positions, for barycentric weights
+    float a_rw, b_rw, c_rw;     // 1/w
+    tex2_t a_uv, b_uv, c_uv;    // for affine texturing
+    tex2_t a_uvw, b_uvw, c_uvw; // uv/w, for perspective correct texturing
+    float a_shade, b_shade, c_shade; // light intensities, for Gouraud shading
+    uint32_t color;
+    texture_t *texture;
+} raster_triangle_t;
+
+// Draws pixels x_start to x_end of row y, returning how many passed the
+// depth test (all of them with it off)
+typedef int (*span_fn)(const raster_triangle_t *t, int y, int x_start, int x_end);
+
+#if defined(__GNUC__)
+#define RASTER_INLINE static inline __attribute__((always_inline))
+#else
+#define RASTER_INLINE static inline
+#endif
+
+// What a span fills its pixels with: the triangle's color, that color lit
+// by intensities interpolated from its vertices, or its texture
+enum span_kind {
+    SPAN_FLAT,
+    SPAN_SHADED,
+    SPAN_TEXTURED
+};
+
+// Pixels between the exact points of subdivided texturing, for this batch
+static int subdivision = 16;
+
+// Shaded spans are lit this many pixels at a time, from a buffer of their
+// intensities
+#define SHADE_CHUNK 64
+
+// Map UV coordinates to a texel, wrapping overshooting coordinates
+RASTER_INLINE uint32_t sample_texture(const texture_t *texture, float u, float v) {
+    int texture_width = texture->width;
+    int texture_height = texture->height;
+    int tex_x = abs((int)(u * texture_width));
+    int tex_y = abs((int)(v * texture_height));
+    int i = texture_width * tex_y + tex_x;
+    int m = texture_width * texture_height;
+    return texture->texels[i % m];
+}
+
+// 1/w and the perspective correct UVs at a pixel
+typedef struct {
+    float rw;
+    float u, v;
+} span_point_t;
+
+RASTER_INLINE span_point_t span_point(const raster_triangle_t *t, int x, int y) {
     vec2_t p = { x, y };
-    vec2_t a = vec2_from_vec4(point_a); 
-    vec2_t b = vec2_from_vec4(point_b); 
-    vec2_t c = vec2_from_vec4(point_c); 
-    vec3_t weights = barycentric_weights(a, b, c, p);
-
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
-
-    // Interpolate and invert 1/w
-    float interpolated_reciprocal_w = alpha * (1/point_a.w) + beta * (1/point_b.w) + gamma * (1/point_c.w);
-    float inv_interpolated_reciprocal_w = 1 - interpolated_reciprocal_w;
-    
-    // Only draw the pixel if the depth value is less than the current one
-    if (inv_interpolated_reciprocal_w < get_z_buffer_at(x, y)) {
-        draw_pixel(x, y, color);
-        update_z_buffer_at(x, y, inv_interpolated_reciprocal_w);
-    }
+    vec3_t weights = barycentric_weights(t->a, t->b, t->c, p);
+    float rw = weights.x * t->a_rw + weights.y * t->b_rw + weights.z * t->c_rw;
+    return (span_point_t) {
+        .rw = rw,
+        .u = (weights.x * t->a_uvw.u + weights.y * t->b_uvw.u + weights.z * t->c_uvw.u) / rw,
+        .v = (weights.x * t->a_uvw.v + weights.y * t->b_uvw.v + weights.z * t->c_uvw.v) / rw,
+    };
 }
 
-void draw_filled_triangle(
-        int x0, int y0, float z0, float w0, 
-        int x1, int y1, float z1, float w1, 
-        int x2, int y2, float z2, float w2, 
-        uint32_t color
+// The one span loop every variant is made from. Each passes constants for
+// the flags, so once inlined the branches on them fold away and the loop
+// only does what its variant needs; clipped spans are cut to the window
+// once, so no pixel is bounds checked.
+RASTER_INLINE int raster_span(
+        const raster_triangle_t *t, int y, int x_start, int x_end,
+        int kind, int mapping, bool depth_test, bool clipped, bool heatmap
 ) {
-    // Sort vertices by y-coordinate (y0 < y1 < y2)
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
+    if (clipped) {
+        if (y < 0 || y >= get_window_height()) return 0;
+        if (x_start < 0) x_start = 0;
+        if (x_end > get_window_width() - 1) x_end = get_window_width() - 1;
     }
-    if (y1 > y2) {
-        int_swap(&y1, &y2);
-        int_swap(&x1, &x2);
-        float_swap(&z1, &z2);
-        float_swap(&w1, &w2);
+
+    uint32_t *color_row = get_color_buffer_row(y);
+    float *z_row = get_z_buffer() + get_window_width() * y;
+
+    int num_passed = 0;
+    bool textured = kind == SPAN_TEXTURED;
+
+    // Interpolate the intensity (and 1/w) from exact values at the ends of
+    // the span, stepping the intensity in 16.16 fixed point; pixels are
+    // filled with the color as they pass and then lit a chunk at a time
+    if (kind == SPAN_SHADED) {
+        if (x_start > x_end) return 0;
+
+        vec3_t left = barycentric_weights(t->a, t->b, t->c, (vec2_t) { x_start, y });
+        vec3_t right = barycentric_weights(t->a, t->b, t->c, (vec2_t) { x_end, y });
+        float left_shade = left.x * t->a_shade + left.y * t->b_shade + left.z * t->c_shade;
+        float right_shade = right.x * t->a_shade + right.y * t->b_shade + right.z * t->c_shade;
+        float left_rw = left.x * t->a_rw + left.y * t->b_rw + left.z * t->c_rw;
+        float right_rw = right.x * t->a_rw + right.y * t->b_rw + right.z * t->c_rw;
+
+        // Clamped, as the weights overshoot a little at the triangle's edges
+        int32_t shade_start = (int32_t)(fminf(fmaxf(left_shade, 0), LIGHT_ONE) * 65536);
+        int32_t shade_end = (int32_t)(fminf(fmaxf(right_shade, 0), LIGHT_ONE) * 65536);
+        int n = x_end - x_start;
+        int32_t shade_step = n > 0 ? (shade_end - shade_start) / n : 0;
+        float rw_step = n > 0 ? (right_rw - left_rw) / n : 0;
+
+        int32_t shade = shade_start;
+        float rw = left_rw;
+        uint16_t shades[SHADE_CHUNK];
+        for (int chunk_start = x_start; chunk_start <= x_end; chunk_start += SHADE_CHUNK) {
+            int chunk_end = chunk_start + SHADE_CHUNK - 1 < x_end ? chunk_start + SHADE_CHUNK - 1 : x_end;
+            for (int x = chunk_start; x <= chunk_end; x++) {
+                float depth = 1 - rw;
+                bool passed = !depth_test || depth < z_row[x];
+                if (heatmap) count_heatmap_at(x, y, passed);
+                if (passed) {
+                    // Pixels that fail keep their color, lit by LIGHT_ONE
+                    color_row[x] = t->color;
+                    if (depth_test) z_row[x] = depth;
+                    shades[x - chunk_start] = shade >> 16;
+                    num_passed += 1;
+                } else {
+                    shades[x - chunk_start] = LIGHT_ONE;
+                }
+                shade += shade_step;
+                rw += rw_step;
+            }
+            light_modulate_colors(color_row + chunk_start, shades, chunk_end - chunk_start + 1);
+        }
+        return num_passed;
     }
-    if (y0 > y1) {
-        int_swap(&y0, &y1);
-        int_swap(&x0, &x1);
-        float_swap(&z0, &z1);
-        float_swap(&w0, &w1);
+
+    // Divide exactly every subdivision pixels (and at the end of the span),
+    // stepping 1/w and the UVs linearly in between, which 1/w is anyway
+    if (textured && mapping == TEXTURE_SUBDIVIDED) {
+        if (x_start > x_end) return 0;
+
+        span_point_t left = span_point(t, x_start, y);
+        int x = x_start;
+        while (x <= x_end) {
+            int n = x_end - x < subdivision ? x_end - x : subdivision;
+            span_point_t right = n > 0 ? span_point(t, x + n, y) : left;
+            float step = n > 0 ? 1.0f / n : 0;
+            float rw_step = (right.rw - left.rw) * step;
+            float u_step = (right.u - left.u) * step;
+            float v_step = (right.v - left.v) * step;
+
+            // Each piece stops short of the next one's exact point, but the
+            // last takes the span's last pixel
+            int piece_end = x + n == x_end ? x_end : x + n - 1;
+            float rw = left.rw;
+            float u = left.u;
+            float v = left.v;
+            for (; x <= piece_end; x++) {
+                float depth = 1 - rw;
+                bool passed = !depth_test || depth < z_row[x];
+                if (heatmap) count_heatmap_at(x, y, passed);
+                if (passed) {
+                    color_row[x] = sample_texture(t->texture, u, v);
+                    if (depth_test) z_row[x] = depth;
+                    num_passed += 1;
+                }
+                rw += rw_step;
+                u += u_step;
+                v += v_step;
+            }
+            left = right;
+        }
+        return num_passed;
+    }
+
+    for (int x = x_start; x <= x_end; x++) {
+        vec2_t p = { x, y };
+        vec3_t weights = barycentric_weights(t->a, t->b, t->c, p);
+
+        float alpha = weights.x;
+        float beta = weights.y;
+        float gamma = weights.z;
+
+        // Interpolate and invert 1/w, so nearer pixels have smaller values
+        float interpolated_reciprocal_w = alpha * t->a_rw + beta * t->b_rw + gamma * t->c_rw;
+        float inv_interpolated_reciprocal_w = 1 - interpolated_reciprocal_w;
+
+        // Only draw the pixel if the depth value is less than the current one
+        bool passed = !depth_test || inv_interpolated_reciprocal_w < z_row[x];
+        if (heatmap) count_heatmap_at(x, y, passed);
+        if (!passed) continue;
+
+        if (textured) {
+            float interpolated_u;
+            float interpolated_v;
+            if (mapping == TEXTURE_PERSPECTIVE) {
+                interpolated_u = alpha * t->a_uvw.u + beta * t->b_uvw.u + gamma * t->c_uvw.u;
+                interpolated_v = alpha * t->a_uvw.v + beta * t->b_uvw.v + gamma * t->c_uvw.v;
+                interpolated_u /= interpolated_reciprocal_w;
+                interpolated_v /= interpolated_reciprocal_w;
+            } else {
+                interpolated_u = alpha * t->a_uv.u + beta * t->b_uv.u + gamma * t->c_uv.u;
+                interpolated_v = alpha * t->a_uv.v + beta * t->b_uv.v + gamma * t->c_uv.v;
+            }
+
+            color_row[x] = sample_texture(t->texture, interpolated_u, interpolated_v);
+        } else {
+            color_row[x] = t->color;
+        }
+        if (depth_test) z_row[x] = inv_interpolated_reciprocal_w;
+        num_passed += 1;
+    }
+    return num_passed;
+}
+
+// Every span variant: name, then its kind, its texture mapping, whether
+// it's depth tested, clipped to the window and counting for the heatmap.
+// Mapping only applies to textured spans, and the heatmap is a debug view
+// so it only comes clipped.
+#define SPAN_VARIANTS(X) \
+    X(flat,                                 SPAN_FLAT,     TEXTURE_AFFINE,      true,  false, false) \
+    X(flat_clipped,                         SPAN_FLAT,     TEXTURE_AFFINE,      true,  true,  false) \
+    X(flat_clipped_heatmap,                 SPAN_FLAT,     TEXTURE_AFFINE,      true,  true,  true)  \
+    X(flat_no_depth,                        SPAN_FLAT,     TEXTURE_AFFINE,      false, false, false) \
+    X(flat_no_depth_clipped,                SPAN_FLAT,     TEXTURE_AFFINE,      false, true,  false) \
+    X(flat_no_depth_clipped_heatmap,        SPAN_FLAT,     TEXTURE_AFFINE,      false, true,  true)  \
+    X(shaded,                               SPAN_SHADED,   TEXTURE_AFFINE,      true,  false, false) \
+    X(shaded_clipped,                       SPAN_SHADED,   TEXTURE_AFFINE,      true,  true,  false) \
+    X(shaded_clipped_heatmap,               SPAN_SHADED,   TEXTURE_AFFINE,      true,  true,  true)  \
+    X(shaded_no_depth,                      SPAN_SHADED,   TEXTURE_AFFINE,      false, false, false) \
+    X(shaded_no_depth_clipped,              SPAN_SHADED,   TEXTURE_AFFINE,      false, true,  false) \
+    X(shaded_no_depth_clipped_heatmap,      SPAN_SHADED,   TEXTURE_AFFINE,      false, true,  true)  \
+    X(textured,                             SPAN_TEXTURED, TEXTURE_PERSPECTIVE, true,  false, false) \
+    X(textured_clipped,                     SPAN_TEXTURED, TEXTURE_PERSPECTIVE, true,  true,  false) \
+    X(textured_clipped_heatmap,             SPAN_TEXTURED, TEXTURE_PERSPECTIVE, true,  true,  true)  \
+    X(textured_no_depth,                    SPAN_TEXTURED, TEXTURE_PERSPECTIVE, false, false, false) \
+    X(textured_no_depth_clipped,            SPAN_TEXTURED, TEXTURE_PERSPECTIVE, false, true,  false) \
+    X(textured_no_depth_clipped_heatmap,    SPAN_TEXTURED, TEXTURE_PERSPECTIVE, false, true,  true)  \
+    X(subdivided,                           SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  true,  false, false) \
+    X(subdivided_clipped,                   SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  true,  true,  false) \
+    X(subdivided_clipped_heatmap,           SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  true,  true,  true)  \
+    X(subdivided_no_depth,                  SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  false, false, false) \
+    X(subdivided_no_depth_clipped,          SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  false, true,  false) \
+    X(subdivided_no_depth_clipped_heatmap,  SPAN_TEXTURED, TEXTURE_SUBDIVIDED,  false, true,  true)  \
+    X(affine,                               SPAN_TEXTURED, TEXTURE_AFFINE,      true,  false, false) \
+    X(affine_clipped,                       SPAN_TEXTURED, TEXTURE_AFFINE,      true,  true,  false) \
+    X(affine_clipped_heatmap,               SPAN_TEXTURED, TEXTURE_AFFINE,      true,  true,  true)  \
+    X(affine_no_depth,                      SPAN_TEXTURED, TEXTURE_AFFINE,      false, false, false) \
+    X(affine_no_depth_clipped,              SPAN_TEXTURED, TEXTURE_AFFINE,      false, true,  false) \
+    X(affine_no_depth_clipped_heatmap,      SPAN_TEXTURED, TEXTURE_AFFINE,      false, true,  true)
+
+#define DEFINE_SPAN(name, kind, mapping, depth_test, clipped, heatmap) \
+    static int name##_span(const raster_triangle_t *t, int y, int x_start, int x_end) { \
+        return raster_span(t, y, x_start, x_end, kind, mapping, depth_test, clipped, heatmap); \
+    }
+SPAN_VARIANTS(DEFINE_SPAN)
+
+typedef struct {
+    span_fn fn;
+    int kind;
+    int mapping;
+    bool depth_test;
+    bool clipped;
+    bool heatmap;
+} span_variant_t;
+
+#define SPAN_VARIANT_ENTRY(name, ...) { name##_span, __VA_ARGS__ },
+static const span_variant_t span_variants[] = {
+    SPAN_VARIANTS(SPAN_VARIANT_ENTRY)
+};
+#define NUM_SPAN_VARIANTS (int)(sizeof(span_variants) / sizeof(span_variants[0]))
+
+static span_fn find_span(int kind, int mapping, bool depth_test, bool clipped, bool heatmap) {
+    for (int i = 0; i < NUM_SPAN_VARIANTS; i += 1) {
+        const span_variant_t *variant = &span_variants[i];
+        if (variant->kind == kind
+            && (kind != SPAN_TEXTURED || variant->mapping == mapping)
+            && variant->depth_test == depth_test
+            && variant->clipped == clipped
+            && variant->heatmap == heatmap) {
+            return variant->fn;
+        }
     }
+    return NULL;
+}
+
+// The variants for the current render state, indexed by whether a triangle
+// needs clipping; the defaults match the default state
+static span_fn flat_spans[2] = { flat_span, flat_clipped_span };
+static span_fn shaded_spans[2] = { shaded_span, shaded_clipped_span };
+static span_fn textured_spans[2] = { textured_span, textured_clipped_span };
+
+// Pick the span variants for the render state (depth test, texture mapping
+// and heatmap), once per batch of triangles rather than per triangle or pixel
+void begin_raster_batch(void) {
+    bool depth_test = get_depth_test();
+    int mapping = get_texture_mapping();
+    bool heatmap = get_heatmap_mode() != HEATMAP_OFF;
+    for (int clipped = 0; clipped <= 1; clipped += 1) {
+        flat_spans[clipped] = find_span(SPAN_FLAT, TEXTURE_AFFINE, depth_test, clipped || heatmap, heatmap);
+        shaded_spans[clipped] = find_span(SPAN_SHADED, TEXTURE_AFFINE, depth_test, clipped || heatmap, heatmap);
+        textured_spans[clipped] = find_span(SPAN_TEXTURED, mapping, depth_test, clipped || heatmap, heatmap);
+    }
+    subdivision = get_texture_subdivision();
+}
+
+// Whether any of a triangle (spanning x from min_x to max_x, y from y0 to
+// y2) falls outside the window, needing a clipped span variant
+static bool needs_clipping(int min_x, int max_x, int y0, int y2) {
+    return min_x < 0 || max_x >= get_window_width() || y0 < 0 || y2 >= get_window_height();
+}
+
+// Pixels a triangle covered, and how many of them passed the depth test
+typedef struct {
+    int covered;
+    int passed;
+} raster_counts_t;
 
-    vec4_t point_a = { x0, y0, z0, w0 };
-    vec4_t point_b = { x1, y1, z1, w1 };
-    vec4_t point_c = { x2, y2, z2, w2 };
+// Walk the rows of a triangle, its vertices sorted by y, drawing each with
+// the variant of spans (unclipped or clipped) it needs, and add up its
+// pixels in the thread's stats
+static raster_counts_t raster_triangle(const raster_triangle_t *triangle, span_fn spans[2]) {
+    int x0 = triangle->a.x, y0 = triangle->a.y;
+    int x1 = triangle->b.x, y1 = triangle->b.y;
+    int x2 = triangle->c.x, y2 = triangle->c.y;
+
+    int min_x = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int max_x = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    span_fn span = spans[needs_clipping(min_x, max_x, y0, y2)];
+
+    // Counted locally and added to the thread's stats once per triangle
+    int num_covered = 0;
+    int num_passed = 0;
 
     // Render the upper part of the triangle (flat-bottom)
     float inv_slope_1 = 0;
@@ -123,9 +400,8 @@ void draw_filled_triangle(
 
             if (x_end < x_start) int_swap(&x_start, &x_end);
 
-            for (int x = x_start; x <= x_end; x++) {
-                draw_solid_pixel(x, y, color, point_a, point_b, point_c);
-            }
+            num_covered += x_end - x_start + 1;
+            num_passed += span(triangle, y, x_start, x_end);
         }
     }
 
@@ -143,73 +419,265 @@ void draw_filled_triangle(
 
             if (x_end < x_start) int_swap(&x_start, &x_end);
 
-            for (int x = x_start; x <= x_end; x++) {
-                draw_solid_pixel(x, y, color, point_a, point_b, point_c);
-            }
+            num_covered += x_end - x_start + 1;
+            num_passed += span(triangle, y, x_start, x_end);
         }
     }
+    pipeline_stats_t *stats = get_thread_stats();
+    stats->pixels_covered += num_covered;
+    stats->depth_passed += num_passed;
+    stats->depth_failed += num_covered - num_passed;
+
+    return (raster_counts_t) { num_covered, num_passed };
 }
 
-void draw_texel(
-        int x, int y, upng_t *texture,
-        vec4_t point_a, vec4_t point_b, vec4_t point_c,
-        tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+void draw_filled_triangle(
+        int x0, int y0, float z0, float w0, 
+        int x1, int y1, float z1, float w1, 
+        int x2, int y2, float z2, float w2, 
+        uint32_t color
 ) {
-    vec2_t p = { x, y };
-    vec2_t a = vec2_from_vec4(point_a); 
-    vec2_t b = vec2_from_vec4(point_b); 
-    vec2_t c = vec2_from_vec4(point_c); 
-    vec3_t weights = barycentric_weights(a, b, c, p);
+    // Sort vertices by y-coordinate (y0 < y1 < y2)
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+        float_swap(&z0, &z1);
+        float_swap(&w0, &w1);
+    }
+    if (y1 > y2) {
+        int_swap(&y1, &y2);
+        int_swap(&x1, &x2);
+        float_swap(&z1, &z2);
+        float_swap(&w1, &w2);
+    }
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+        float_swap(&z0, &z1);
+        float_swap(&w0, &w1);
+    }
 
-    float alpha = weights.x;
-    float beta = weights.y;
-    float gamma = weights.z;
+    raster_triangle_t triangle = {
+        .a = { x0, y0 },
+        .b = { x1, y1 },
+        .c = { x2, y2 },
+        .a_rw = 1 / w0,
+        .b_rw = 1 / w1,
+        .c_rw = 1 / w2,
+        .color = color,
+    };
+    raster_triangle(&triangle, flat_spans);
+}
 
-    // Store interpolated values for current pixel
-    float interpolated_u;
-    float interpolated_v;
-    float interpolated_reciprocal_w;
+// Like draw_filled_triangle, but lighting the color by intensities (0 to
+// LIGHT_ONE) given at the vertices and interpolated across the triangle
+void draw_shaded_triangle(
+        int x0, int y0, float z0, float w0, float i0,
+        int x1, int y1, float z1, float w1, float i1,
+        int x2, int y2, float z2, float w2, float i2,
+        uint32_t color
+) {
+    // Sort vertices by y-coordinate (y0 < y1 < y2)
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+        float_swap(&z0, &z1);
+        float_swap(&w0, &w1);
+        float_swap(&i0, &i1);
+    }
+    if (y1 > y2) {
+        int_swap(&y1, &y2);
+        int_swap(&x1, &x2);
+        float_swap(&z1, &z2);
+        float_swap(&w1, &w2);
+        float_swap(&i1, &i2);
+    }
+    if (y0 > y1) {
+        int_swap(&y0, &y1);
+        int_swap(&x0, &x1);
+        float_swap(&z0, &z1);
+        float_swap(&w0, &w1);
+        float_swap(&i0, &i1);
+    }
 
-    // Perform the interpolation of all U and V values using barycentric weights and 1/w factor
-    interpolated_u = alpha * (a_uv.u/point_a.w) + beta * (b_uv.u/point_b.w) + gamma * (c_uv.u/point_c.w);
-    interpolated_v = alpha * (a_uv.v/point_a.w) + beta * (b_uv.v/point_b.w) + gamma * (c_uv.v/point_c.w);
+    raster_triangle_t triangle = {
+        .a = { x0, y0 },
+        .b = { x1, y1 },
+        .c = { x2, y2 },
+        .a_rw = 1 / w0,
+        .b_rw = 1 / w1,
+        .c_rw = 1 / w2,
+        .a_shade = i0,
+        .b_shade = i1,
+        .c_shade = i2,
+        .color = color,
+    };
+    raster_triangle(&triangle, shaded_spans);
+}
 
-    // Also interpolate the value of 1/w for the current pixel
-    interpolated_reciprocal_w = alpha * (1/point_a.w) + beta * (1/point_b.w) + gamma * (1/point_c.w);
+#define UNORM16_MAX 65535
+
+bool init_depth_buffer(depth_buffer_t *buffer, int width, int height, int format) {
+    size_t size = format == DEPTH_UNORM16 ? sizeof(uint16_t) : sizeof(float);
+    buffer->format = format;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->depth = malloc(size * width * height);
+    if (!buffer->depth) {
+        fprintf(stderr, "Error allocating a %dx%d depth buffer.\n", width, height);
+        return false;
+    }
+    clear_depth_buffer(buffer);
+    return true;
+}
 
-    interpolated_u /= interpolated_reciprocal_w;
-    interpolated_v /= interpolated_reciprocal_w;
+void clear_depth_buffer(depth_buffer_t *buffer) {
+    int count = buffer->width * buffer->height;
+    if (buffer->format == DEPTH_UNORM16) {
+        uint16_t *depth = buffer->depth;
+        for (int i = 0; i < count; i += 1) depth[i] = UNORM16_MAX;
+    } else {
+        float *depth = buffer->depth;
+        for (int i = 0; i < count; i += 1) depth[i] = 1.0;
+    }
+}
 
-    // Get the mesh texture width and height dimensions
-    int texture_width = upng_get_width(texture);
-    int texture_height = upng_get_height(texture);
+void free_depth_buffer(depth_buffer_t *buffer) {
+    free(buffer->depth);
+    buffer->depth = NULL;
+}
 
-    // Map the UV coordinates to the full texture width and height
-    int tex_x = abs((int)(interpolated_u * texture_width));
-    int tex_y = abs((int)(interpolated_v * texture_height));
+// The display's z-buffer at the current resolution, to draw into with
+// draw_depth_triangle (e.g. a z-prepass before the color pass)
+depth_buffer_t get_z_buffer_target(void) {
+    return (depth_buffer_t) {
+        .format = DEPTH_FLOAT32,
+        .width = get_window_width(),
+        .height = get_window_height(),
+        .depth = get_z_buffer(),
+    };
+}
 
-    // Guard against buffer overflow by wrapping overshooting coordinates
-    int i = texture_width * tex_y + tex_x;
-    int m = texture_width * texture_height;
+// Twice the signed area of abp: positive when p is to the right of a -> b
+// (screen y pointing down), zero on the line
+static int edge_function(int ax, int ay, int bx, int by, int px, int py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
 
-    // Adjust 1/w so the pixels that are closer have smaller values
-    float inv_interpolated_reciprocal_w = 1 - interpolated_reciprocal_w;
-    
-    // Only draw the pixel if the depth value is less than the current one
-    if (inv_interpolated_reciprocal_w < get_z_buffer_at(x, y)) {
-        // Get the buffer of colors from the texture
-        uint32_t *texture_buffer = (uint32_t *)upng_get_buffer(texture);
-        // Update the color and z-buffers
-        draw_pixel(x, y, texture_buffer[i % m]);
-        update_z_buffer_at(x, y, inv_interpolated_reciprocal_w);
+// Pixels exactly on an edge shared by two triangles belong to only one of
+// them: the one the edge is a top or left edge of
+static bool is_top_left_edge(int ax, int ay, int bx, int by) {
+    bool top = ay == by && bx > ax;
+    bool left = by < ay;
+    return top || left;
+}
+
+// Write a triangle's depth, and nothing else, into a depth buffer. Rather
+// than walking spans, this tests every pixel of the triangle's bounding box
+// against its three edge functions, which step by a constant per pixel, and
+// interpolates 1/w (linear in screen space) the same way. Triangles facing
+// either way are drawn.
+void draw_depth_triangle(
+        depth_buffer_t *target,
+        int x0, int y0, float w0,
+        int x1, int y1, float w1,
+        int x2, int y2, float w2
+) {
+    // Wind the triangle so the edge functions are positive inside it
+    int area = edge_function(x0, y0, x1, y1, x2, y2);
+    if (area == 0) return;
+    if (area < 0) {
+        int_swap(&x1, &x2);
+        int_swap(&y1, &y2);
+        float_swap(&w1, &w2);
+        area = -area;
+    }
+
+    // Bounding box, clipped to the target
+    int min_x = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    int min_y = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    int max_x = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    int max_y = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x > target->width - 1) max_x = target->width - 1;
+    if (max_y > target->height - 1) max_y = target->height - 1;
+    if (min_x > max_x || min_y > max_y) return;
+
+    // Edge functions opposite each vertex at the top left of the box, less
+    // one for edges whose pixels belong to the neighbouring triangle
+    int e0_row = edge_function(x1, y1, x2, y2, min_x, min_y) - !is_top_left_edge(x1, y1, x2, y2);
+    int e1_row = edge_function(x2, y2, x0, y0, min_x, min_y) - !is_top_left_edge(x2, y2, x0, y0);
+    int e2_row = edge_function(x0, y0, x1, y1, min_x, min_y) - !is_top_left_edge(x0, y0, x1, y1);
+
+    // How much each steps by per pixel across and per row down
+    int e0_dx = y1 - y2, e0_dy = x2 - x1;
+    int e1_dx = y2 - y0, e1_dy = x0 - x2;
+    int e2_dx = y0 - y1, e2_dy = x1 - x0;
+
+    // 1/w at the top left, weighted by the (unbiased) edge functions, and
+    // its steps
+    float rw0 = 1 / w0 / area;
+    float rw1 = 1 / w1 / area;
+    float rw2 = 1 / w2 / area;
+    float rw_row =
+        edge_function(x1, y1, x2, y2, min_x, min_y) * rw0 +
+        edge_function(x2, y2, x0, y0, min_x, min_y) * rw1 +
+        edge_function(x0, y0, x1, y1, min_x, min_y) * rw2;
+    float rw_dx = e0_dx * rw0 + e1_dx * rw1 + e2_dx * rw2;
+    float rw_dy = e0_dy * rw0 + e1_dy * rw1 + e2_dy * rw2;
+
+    int num_covered = 0;
+    int num_passed = 0;
+    for (int y = min_y; y <= max_y; y += 1) {
+        int e0 = e0_row, e1 = e1_row, e2 = e2_row;
+        float rw = rw_row;
+        if (target->format == DEPTH_UNORM16) {
+            uint16_t *row = (uint16_t *)target->depth + target->width * y;
+            for (int x = min_x; x <= max_x; x += 1) {
+                // Inside when no edge function is negative
+                if ((e0 | e1 | e2) >= 0) {
+                    float depth = 1 - rw;
+                    uint16_t q = depth <= 0 ? 0 : (uint16_t)(depth * UNORM16_MAX + 0.5f);
+                    num_covered += 1;
+                    if (q < row[x]) {
+                        row[x] = q;
+                        num_passed += 1;
+                    }
+                }
+                e0 += e0_dx; e1 += e1_dx; e2 += e2_dx;
+                rw += rw_dx;
+            }
+        } else {
+            float *row = (float *)target->depth + target->width * y;
+            for (int x = min_x; x <= max_x; x += 1) {
+                if ((e0 | e1 | e2) >= 0) {
+                    float depth = 1 - rw;
+                    num_covered += 1;
+                    if (depth < row[x]) {
+                        row[x] = depth;
+                        num_passed += 1;
+                    }
+                }
+                e0 += e0_dx; e1 += e1_dx; e2 += e2_dx;
+                rw += rw_dx;
+            }
+        }
+        e0_row += e0_dy; e1_row += e1_dy; e2_row += e2_dy;
+        rw_row += rw_dy;
     }
+
+    pipeline_stats_t *stats = get_thread_stats();
+    stats->pixels_covered += num_covered;
+    stats->depth_passed += num_passed;
+    stats->depth_failed += num_covered - num_passed;
 }
 
 void draw_textured_triangle(
         int x0, int y0, float z0, float w0, float u0, float v0,
         int x1, int y1, float z1, float w1, float u1, float v1,
         int x2, int y2, float z2, float w2, float u2, float v2,
-        upng_t *texture
+        texture_t *texture
 ) {
     // Sort vertices by y-coordinate (y0 < y1 < y2)
     if (y0 > y1) {
@@ -242,53 +710,21 @@ void draw_textured_triangle(
     v1 = 1 - v1;
     v2 = 1 - v2;
 
-    // Create vector points after sorting vetices
-    vec4_t point_a = { x0, y0, z0, w0 };
-    vec4_t point_b = { x1, y1, z1, w1 };
-    vec4_t point_c = { x2, y2, z2, w2 };
-
-    // Create texture coordinates
-    tex2_t a_uv = { u0, v0 };
-    tex2_t b_uv = { u1, v1 };
-    tex2_t c_uv = { u2, v2 };
-
-    // Render the upper part of the triangle (flat-bottom)
-    float inv_slope_1 = 0;
-    float inv_slope_2 = 0;
-
-    if (y1 - y0 != 0) inv_slope_1 = (float)(x1 - x0) / abs(y1 - y0);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-
-    if (y1 - y0 != 0) {
-        for (int y = y0; y <= y1; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);
-
-            for (int x = x_start; x <= x_end; x++) {
-                draw_texel(x, y, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
-            }
-        }
-    }
-
-    // Render the bottom part of the triangle (flat-top)
-    inv_slope_1 = 0;
-    inv_slope_2 = 0;
-
-    if (y2 - y1 != 0) inv_slope_1 = (float)(x2 - x1) / abs(y2 - y1);
-    if (y2 - y0 != 0) inv_slope_2 = (float)(x2 - x0) / abs(y2 - y0);
-
-    if (y2 - y1 != 0) {
-        for (int y = y1; y <= y2; y++) {
-            int x_start = x1 + (y - y1) * inv_slope_1;
-            int x_end = x0 + (y - y0) * inv_slope_2;
-
-            if (x_end < x_start) int_swap(&x_start, &x_end);
-
-            for (int x = x_start; x <= x_end; x++) {
-                draw_texel(x, y, texture, point_a, point_b, point_c, a_uv, b_uv, c_uv);
-            }
-        }
-    }
+    raster_triangle_t triangle = {
+        .a = { x0, y0 },
+        .b = { x1, y1 },
+        .c = { x2, y2 },
+        .a_rw = 1 / w0,
+        .b_rw = 1 / w1,
+        .c_rw = 1 / w2,
+        .a_uv = { u0, v0 },
+        .b_uv = { u1, v1 },
+        .c_uv = { u2, v2 },
+        .a_uvw = { u0 / w0, v0 / w0 },
+        .b_uvw = { u1 / w1, v1 / w1 },
+        .c_uvw = { u2 / w2, v2 / w2 },
+        .texture = texture,
+    };
+    raster_counts_t counts = raster_triangle(&triangle, textured_spans);
+    get_thread_stats()->texels_fetched += counts.passed;
 }
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "vector.h"
 #include "texture.h"
-#include "upng.h"
 
 typedef struct {
     int a;
@@ -12,38 +13,67 @@ typedef struct {
     tex2_t a_uv;
     tex2_t b_uv;
     tex2_t c_uv;
+    int a_normal; // indices into the mesh's normals
+    int b_normal;
+    int c_normal;
     uint32_t color;
 } face_t;
 
+// Formats of depth buffers drawn by draw_depth_triangle. Both hold the
+// same depth as the z-buffer (1 - 1/w, from 0 up to 1 for cleared), one
+// quantized to 16 bits for half the memory traffic.
+enum depth_format {
+    DEPTH_FLOAT32,
+    DEPTH_UNORM16,
+};
+
+// A depth-only target, e.g. for a z-prepass, an occlusion buffer or a
+// shadow map; rows are contiguous
+typedef struct {
+    int format;
+    int width;
+    int height;
+    void *depth; // width * height floats or uint16_ts, per format
+} depth_buffer_t;
+
 typedef struct {
     vec4_t points[3];
     tex2_t texcoords[3];
+    float intensities[3]; // Gouraud shading, 0 to LIGHT_ONE
     uint32_t color;
-    upng_t *texture;
+    texture_t *texture;
 } triangle_t;
 
 vec3_t get_triangle_normal(vec4_t transformed_vertices[3]);
 
 vec3_t barycentric_weights(vec2_t a, vec2_t b, vec2_t c, vec2_t p);
-void draw_solid_pixel(
-    int x, int y, uint32_t color,
-    vec4_t point_a, vec4_t point_b, vec4_t point_c
-);
+void begin_raster_batch(void);
 void draw_filled_triangle(
         int x0, int y0, float z0, float w0, 
         int x1, int y1, float z1, float w1, 
         int x2, int y2, float z2, float w2, 
         uint32_t color
 );
-void draw_texel(
-        int x, int y, upng_t *texture,
-        vec4_t point_a, vec4_t point_b, vec4_t point_c,
-        tex2_t a_uv, tex2_t b_uv, tex2_t c_uv
+void draw_shaded_triangle(
+        int x0, int y0, float z0, float w0, float i0,
+        int x1, int y1, float z1, float w1, float i1,
+        int x2, int y2, float z2, float w2, float i2,
+        uint32_t color
+);
+bool init_depth_buffer(depth_buffer_t *buffer, int width, int height, int format);
+void clear_depth_buffer(depth_buffer_t *buffer);
+void free_depth_buffer(depth_buffer_t *buffer);
+depth_buffer_t get_z_buffer_target(void);
+void draw_depth_triangle(
+        depth_buffer_t *target,
+        int x0, int y0, float w0,
+        int x1, int y1, float w1,
+        int x2, int y2, float w2
 );
 void draw_textured_triangle(
         int x0, int y0, float z0, float w0, float u0, float v0,
         int x1, int y1, float z1, float w1, float u1, float v1,
         int x2, int y2, float z2, float w2, float u2, float v2,
-        upng_t *texture
+        texture_t *texture
 );
 
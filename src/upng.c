@@ -28,6 +28,12 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define UPNG_SSE2
+#endif
 
 #include "upng.h"
 
@@ -36,6 +42,8 @@ freely, subject to the following restrictions:
 #define MAKE_DWORD_PTR(p) MAKE_DWORD((p)[0], (p)[1], (p)[2], (p)[3])
 
 #define CHUNK_IHDR MAKE_DWORD('I','H','D','R')
+#define CHUNK_PLTE MAKE_DWORD('P','L','T','E')
+#define CHUNK_tRNS MAKE_DWORD('t','R','N','S')
 #define CHUNK_IDAT MAKE_DWORD('I','D','A','T')
 #define CHUNK_IEND MAKE_DWORD('I','E','N','D')
 
@@ -47,14 +55,29 @@ freely, subject to the following restrictions:
 #define NUM_CODE_LENGTH_CODES 19	/*the code length codes. 0-15: code lengths, 16: copy previous 3-6 times, 17: 3-10 zeros, 18: 11-138 zeros */
 #define MAX_SYMBOLS 288 /* largest number of symbols used by any tree type */
 
-#define DEFLATE_CODE_BITLEN 15
-#define DISTANCE_BITLEN 15
-#define CODE_LENGTH_BITLEN 7
 #define MAX_BIT_LENGTH 15 /* largest bitlen used by any tree type */
 
-#define DEFLATE_CODE_BUFFER_SIZE (NUM_DEFLATE_CODE_SYMBOLS * 2)
-#define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
-#define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
+/* Huffman codes are decoded with a primary table indexed by the next HUFFMAN_FAST_BITS bits of input. Codes longer than that
+ * are resolved through a subtable linked from the primary entry of their first HUFFMAN_FAST_BITS bits. There is at most one
+ * subtable per symbol, each with at most 2^(MAX_BIT_LENGTH - HUFFMAN_FAST_BITS) entries. */
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_FAST_SIZE (1u << HUFFMAN_FAST_BITS)
+#define HUFFMAN_FAST_MASK (HUFFMAN_FAST_SIZE - 1)
+#define HUFFMAN_TABLE_SIZE(numcodes) (HUFFMAN_FAST_SIZE + (numcodes) * (1u << (MAX_BIT_LENGTH - HUFFMAN_FAST_BITS)))
+
+/* a table entry is a symbol (or subtable offset) in the upper bits and a bit count in the low 4 bits; a count of 0 marks an
+ * invalid code, and HUFFMAN_SUBTABLE marks a link where the count is the number of extra bits indexing the subtable */
+#define HUFFMAN_SUBTABLE 0x10
+#define HUFFMAN_ENTRY(value, bits) (((uint32_t)(value) << 8) | (bits))
+#define HUFFMAN_ENTRY_VALUE(entry) ((entry) >> 8)
+#define HUFFMAN_ENTRY_BITS(entry) ((entry) & 0x0F)
+
+#define DEFLATE_CODE_BUFFER_SIZE HUFFMAN_TABLE_SIZE(NUM_DEFLATE_CODE_SYMBOLS)
+#define DISTANCE_BUFFER_SIZE HUFFMAN_TABLE_SIZE(NUM_DISTANCE_SYMBOLS)
+#define CODE_LENGTH_BUFFER_SIZE HUFFMAN_TABLE_SIZE(NUM_CODE_LENGTH_CODES)
+
+#define TRACE_PHASE_BEGIN(upng,name) do { if ((upng)->trace_begin) (upng)->trace_begin(name); } while (0)
+#define TRACE_PHASE_END(upng,name) do { if ((upng)->trace_end) (upng)->trace_end(name); } while (0)
 
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
@@ -72,6 +95,7 @@ typedef enum upng_state {
 typedef enum upng_color {
 	UPNG_LUM		= 0,
 	UPNG_RGB		= 2,
+	UPNG_PLT		= 3,
 	UPNG_LUMA		= 4,
 	UPNG_RGBA		= 6
 } upng_color;
@@ -93,18 +117,34 @@ struct upng_t {
 	unsigned char*	buffer;
 	unsigned long	size;
 
+	unsigned char	palette[256 * 4];	/*RGBA entries from PLTE, alpha from tRNS */
+	unsigned		palette_size;
+
 	upng_error		error;
 	unsigned		error_line;
 
 	upng_state		state;
 	upng_source		source;
+
+	upng_trace_fn	trace_begin;	/*optional hooks around decoding phases (see upng_set_trace) */
+	upng_trace_fn	trace_end;
+
+	int				use_simd;	/*whether to use the SIMD code paths where available (see upng_set_simd) */
 };
 
-typedef struct huffman_tree {
-	unsigned* tree2d;
-	unsigned maxbitlen;	/*maximum number of bits a single code can get */
+typedef struct huffman_table {
+	uint32_t* entries;	/*primary table followed by its subtables */
 	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
-} huffman_tree;
+} huffman_table;
+
+typedef struct bit_reader {
+	const unsigned char* in;
+	unsigned long size;	/*number of bytes in the stream */
+	unsigned long pos;	/*next byte to load into the buffer */
+	uint64_t buffer;	/*bits loaded but not consumed yet, next bit in the lsb */
+	unsigned count;	/*number of valid bits in buffer */
+	unsigned padding;	/*zero bits loaded past the end of the stream, always the top bits of the buffer */
+} bit_reader;
 
 static const unsigned LENGTH_BASE[29] = {	/*the base lengths represented by codes 257-285 */
 	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
@@ -129,204 +169,215 @@ static const unsigned DISTANCE_EXTRA[30] = {	/*the extra bits of backwards dista
 static const unsigned CLCL[NUM_CODE_LENGTH_CODES]	/*the order in which "code length alphabet code lengths" are stored, out of this the huffman tree of the dynamic huffman tree lengths is generated */
 = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
 
-static const unsigned FIXED_DEFLATE_CODE_TREE[NUM_DEFLATE_CODE_SYMBOLS * 2] = {
-	289, 370, 290, 307, 546, 291, 561, 292, 293, 300, 294, 297, 295, 296, 0, 1,
-	2, 3, 298, 299, 4, 5, 6, 7, 301, 304, 302, 303, 8, 9, 10, 11, 305, 306, 12,
-	13, 14, 15, 308, 339, 309, 324, 310, 317, 311, 314, 312, 313, 16, 17, 18,
-	19, 315, 316, 20, 21, 22, 23, 318, 321, 319, 320, 24, 25, 26, 27, 322, 323,
-	28, 29, 30, 31, 325, 332, 326, 329, 327, 328, 32, 33, 34, 35, 330, 331, 36,
-	37, 38, 39, 333, 336, 334, 335, 40, 41, 42, 43, 337, 338, 44, 45, 46, 47,
-	340, 355, 341, 348, 342, 345, 343, 344, 48, 49, 50, 51, 346, 347, 52, 53,
-	54, 55, 349, 352, 350, 351, 56, 57, 58, 59, 353, 354, 60, 61, 62, 63, 356,
-	363, 357, 360, 358, 359, 64, 65, 66, 67, 361, 362, 68, 69, 70, 71, 364,
-	367, 365, 366, 72, 73, 74, 75, 368, 369, 76, 77, 78, 79, 371, 434, 372,
-	403, 373, 388, 374, 381, 375, 378, 376, 377, 80, 81, 82, 83, 379, 380, 84,
-	85, 86, 87, 382, 385, 383, 384, 88, 89, 90, 91, 386, 387, 92, 93, 94, 95,
-	389, 396, 390, 393, 391, 392, 96, 97, 98, 99, 394, 395, 100, 101, 102, 103,
-	397, 400, 398, 399, 104, 105, 106, 107, 401, 402, 108, 109, 110, 111, 404,
-	419, 405, 412, 406, 409, 407, 408, 112, 113, 114, 115, 410, 411, 116, 117,
-	118, 119, 413, 416, 414, 415, 120, 121, 122, 123, 417, 418, 124, 125, 126,
-	127, 420, 427, 421, 424, 422, 423, 128, 129, 130, 131, 425, 426, 132, 133,
-	134, 135, 428, 431, 429, 430, 136, 137, 138, 139, 432, 433, 140, 141, 142,
-	143, 435, 483, 436, 452, 568, 437, 438, 445, 439, 442, 440, 441, 144, 145,
-	146, 147, 443, 444, 148, 149, 150, 151, 446, 449, 447, 448, 152, 153, 154,
-	155, 450, 451, 156, 157, 158, 159, 453, 468, 454, 461, 455, 458, 456, 457,
-	160, 161, 162, 163, 459, 460, 164, 165, 166, 167, 462, 465, 463, 464, 168,
-	169, 170, 171, 466, 467, 172, 173, 174, 175, 469, 476, 470, 473, 471, 472,
-	176, 177, 178, 179, 474, 475, 180, 181, 182, 183, 477, 480, 478, 479, 184,
-	185, 186, 187, 481, 482, 188, 189, 190, 191, 484, 515, 485, 500, 486, 493,
-	487, 490, 488, 489, 192, 193, 194, 195, 491, 492, 196, 197, 198, 199, 494,
-	497, 495, 496, 200, 201, 202, 203, 498, 499, 204, 205, 206, 207, 501, 508,
-	502, 505, 503, 504, 208, 209, 210, 211, 506, 507, 212, 213, 214, 215, 509,
-	512, 510, 511, 216, 217, 218, 219, 513, 514, 220, 221, 222, 223, 516, 531,
-	517, 524, 518, 521, 519, 520, 224, 225, 226, 227, 522, 523, 228, 229, 230,
-	231, 525, 528, 526, 527, 232, 233, 234, 235, 529, 530, 236, 237, 238, 239,
-	532, 539, 533, 536, 534, 535, 240, 241, 242, 243, 537, 538, 244, 245, 246,
-	247, 540, 543, 541, 542, 248, 249, 250, 251, 544, 545, 252, 253, 254, 255,
-	547, 554, 548, 551, 549, 550, 256, 257, 258, 259, 552, 553, 260, 261, 262,
-	263, 555, 558, 556, 557, 264, 265, 266, 267, 559, 560, 268, 269, 270, 271,
-	562, 565, 563, 564, 272, 273, 274, 275, 566, 567, 276, 277, 278, 279, 569,
-	572, 570, 571, 280, 281, 282, 283, 573, 574, 284, 285, 286, 287, 0, 0
-};
+static void bit_reader_init(bit_reader* br, const unsigned char* in, unsigned long size)
+{
+	br->in = in;
+	br->size = size;
+	br->pos = 0;
+	br->buffer = 0;
+	br->count = 0;
+	br->padding = 0;
+}
 
-static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
-	33, 48, 34, 41, 35, 38, 36, 37, 0, 1, 2, 3, 39, 40, 4, 5, 6, 7, 42, 45, 43,
-	44, 8, 9, 10, 11, 46, 47, 12, 13, 14, 15, 49, 56, 50, 53, 51, 52, 16, 17,
-	18, 19, 54, 55, 20, 21, 22, 23, 57, 60, 58, 59, 24, 25, 26, 27, 61, 62, 28,
-	29, 30, 31, 0, 0
-};
+/* top up the buffer to at least 57 bits, so any single symbol plus its extra bits can be read without another refill */
+static void bit_reader_refill(bit_reader* br)
+{
+	while (br->count <= 56) {
+		uint64_t byte = 0;
+		if (br->pos < br->size) {
+			byte = br->in[br->pos++];
+		} else {
+			br->padding += 8;
+		}
+		br->buffer |= byte << br->count;
+		br->count += 8;
+	}
+}
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/* whether bits past the end of the stream were consumed */
+static int bit_reader_overrun(const bit_reader* br)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
+	return br->count < br->padding;
+}
+
+static unsigned read_bits(bit_reader* br, unsigned nbits)
+{
+	unsigned result;
+	if (br->count < nbits) {
+		bit_reader_refill(br);
+	}
+	result = (unsigned)(br->buffer & ((1u << nbits) - 1));
+	br->buffer >>= nbits;
+	br->count -= nbits;
 	return result;
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+static unsigned reverse_bits(unsigned code, unsigned nbits)
 {
 	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
+	for (i = 0; i < nbits; i++) {
+		result = (result << 1) | ((code >> i) & 1);
+	}
 	return result;
 }
 
-/* the buffer must be numcodes*2 in size! */
-static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
+/* the buffer must be HUFFMAN_TABLE_SIZE(numcodes) in size! */
+static void huffman_table_init(huffman_table* table, uint32_t* buffer, unsigned numcodes)
 {
-	tree->tree2d = buffer;
-
-	tree->numcodes = numcodes;
-	tree->maxbitlen = maxbitlen;
+	table->entries = buffer;
+	table->numcodes = numcodes;
 }
 
-/*given the code lengths (as stored in the PNG file), generate the tree as defined by Deflate. maxbitlen is the maximum bits that a code in the tree can have. return value is error.*/
-static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const unsigned *bitlen)
+/*given the code lengths (as stored in the PNG file), generate the lookup tables for the canonical code as defined by Deflate*/
+static void huffman_table_create_lengths(upng_t* upng, huffman_table* table, const unsigned *bitlen)
 {
-	unsigned tree1d[MAX_SYMBOLS];
-	unsigned blcount[MAX_BIT_LENGTH];
-	unsigned nextcode[MAX_BIT_LENGTH+1];
+	unsigned reversed[MAX_SYMBOLS];	/*codes with their bits reversed, since Deflate stores them msb first */
+	unsigned blcount[MAX_BIT_LENGTH + 1];
+	unsigned nextcode[MAX_BIT_LENGTH + 1];
+	unsigned char sublen[HUFFMAN_FAST_SIZE];
 	unsigned bits, n, i;
-	unsigned nodefilled = 0;	/*up to which node it is filled */
-	unsigned treepos = 0;	/*position in the tree (1 of the numcodes columns) */
+	unsigned used = HUFFMAN_FAST_SIZE;	/*entries used by the primary table and subtables so far */
+	int left = 1;
 
 	/* initialize local vectors */
 	memset(blcount, 0, sizeof(blcount));
 	memset(nextcode, 0, sizeof(nextcode));
+	memset(sublen, 0, sizeof(sublen));
 
 	/*step 1: count number of instances of each code length */
-	for (bits = 0; bits < tree->numcodes; bits++) {
-		blcount[bitlen[bits]]++;
+	for (n = 0; n < table->numcodes; n++) {
+		blcount[bitlen[n]]++;
+	}
+	blcount[0] = 0;
+
+	/* reject oversubscribed codes; incomplete ones are allowed (e.g. a single distance code) */
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
+		left = (left << 1) - (int)blcount[bits];
+		if (left < 0) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
+		}
 	}
 
 	/*step 2: generate the nextcode values */
-	for (bits = 1; bits <= tree->maxbitlen; bits++) {
+	for (bits = 1; bits <= MAX_BIT_LENGTH; bits++) {
 		nextcode[bits] = (nextcode[bits - 1] + blcount[bits - 1]) << 1;
 	}
 
-	/*step 3: generate all the codes */
-	for (n = 0; n < tree->numcodes; n++) {
+	/*step 3: generate all the codes, and find how many extra bits the subtable under each primary entry needs */
+	for (n = 0; n < table->numcodes; n++) {
 		if (bitlen[n] != 0) {
-			tree1d[n] = nextcode[bitlen[n]]++;
+			reversed[n] = reverse_bits(nextcode[bitlen[n]]++, bitlen[n]);
+			if (bitlen[n] > HUFFMAN_FAST_BITS) {
+				unsigned prefix = reversed[n] & HUFFMAN_FAST_MASK;
+				if (bitlen[n] - HUFFMAN_FAST_BITS > sublen[prefix]) {
+					sublen[prefix] = (unsigned char)(bitlen[n] - HUFFMAN_FAST_BITS);
+				}
+			}
 		}
 	}
 
-	/*convert tree1d[] to tree2d[][]. In the 2D array, a value of 32767 means uninited, a value >= numcodes is an address to another bit, a value < numcodes is a code. The 2 rows are the 2 possible bit values (0 or 1), there are as many columns as codes - 1
-	   a good huffmann tree has N * 2 - 1 nodes, of which N - 1 are internal nodes. Here, the internal nodes are stored (what their 0 and 1 option point to). There is only memory for such good tree currently, if there are more nodes (due to too long length codes), error 55 will happen */
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		tree->tree2d[n] = 32767;	/*32767 here means the tree2d isn't filled there yet */
+	/*step 4: lay out the subtables after the primary table; unfilled entries stay invalid */
+	memset(table->entries, 0, HUFFMAN_FAST_SIZE * sizeof(uint32_t));
+	for (i = 0; i < HUFFMAN_FAST_SIZE; i++) {
+		if (sublen[i] != 0) {
+			table->entries[i] = HUFFMAN_ENTRY(used, HUFFMAN_SUBTABLE | sublen[i]);
+			memset(&table->entries[used], 0, (1u << sublen[i]) * sizeof(uint32_t));
+			used += 1u << sublen[i];
+		}
 	}
 
-	for (n = 0; n < tree->numcodes; n++) {	/*the codes */
-		for (i = 0; i < bitlen[n]; i++) {	/*the bits for this code */
-			unsigned char bit = (unsigned char)((tree1d[n] >> (bitlen[n] - i - 1)) & 1);
-			/* check if oversubscribed */
-			if (treepos > tree->numcodes - 2) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
+	/*step 5: fill in every entry whose low bits match a code */
+	for (n = 0; n < table->numcodes; n++) {
+		unsigned len = bitlen[n];
+		uint32_t entry = HUFFMAN_ENTRY(n, len);
 
-			if (tree->tree2d[2 * treepos + bit] == 32767) {	/*not yet filled in */
-				if (i + 1 == bitlen[n]) {	/*last bit */
-					tree->tree2d[2 * treepos + bit] = n;	/*put the current code in it */
-					treepos = 0;
-				} else {	/*put address of the next step in here, first that address has to be found of course (it's just nodefilled + 1)... */
-					nodefilled++;
-					tree->tree2d[2 * treepos + bit] = nodefilled + tree->numcodes;	/*addresses encoded with numcodes added to it */
-					treepos = nodefilled;
-				}
-			} else {
-				treepos = tree->tree2d[2 * treepos + bit] - tree->numcodes;
-			}
+		if (len == 0) {
+			continue;
 		}
-	}
 
-	for (n = 0; n < tree->numcodes * 2; n++) {
-		if (tree->tree2d[n] == 32767) {
-			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
+		if (len <= HUFFMAN_FAST_BITS) {
+			for (i = reversed[n]; i < HUFFMAN_FAST_SIZE; i += 1u << len) {
+				table->entries[i] = entry;
+			}
+		} else {
+			uint32_t link = table->entries[reversed[n] & HUFFMAN_FAST_MASK];
+			uint32_t *subtable = &table->entries[HUFFMAN_ENTRY_VALUE(link)];
+			unsigned size = 1u << HUFFMAN_ENTRY_BITS(link);
+			for (i = reversed[n] >> HUFFMAN_FAST_BITS; i < size; i += 1u << (len - HUFFMAN_FAST_BITS)) {
+				subtable[i] = entry;
+			}
 		}
 	}
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+static unsigned huffman_decode_symbol(upng_t *upng, bit_reader* br, const huffman_table* table)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	uint32_t entry;
 
-		bit = read_bit(bp, in);
+	if (br->count < MAX_BIT_LENGTH) {
+		bit_reader_refill(br);
+	}
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
-		}
+	entry = table->entries[br->buffer & HUFFMAN_FAST_MASK];
+	if (entry & HUFFMAN_SUBTABLE) {
+		unsigned index = (unsigned)(br->buffer >> HUFFMAN_FAST_BITS) & ((1u << HUFFMAN_ENTRY_BITS(entry)) - 1);
+		entry = table->entries[HUFFMAN_ENTRY_VALUE(entry) + index];
+	}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	/* error: the bits don't match any code */
+	if (HUFFMAN_ENTRY_BITS(entry) == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
 	}
+
+	br->buffer >>= HUFFMAN_ENTRY_BITS(entry);
+	br->count -= HUFFMAN_ENTRY_BITS(entry);
+
+	/* error: end of input memory reached without endcode */
+	if (bit_reader_overrun(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+
+	return HUFFMAN_ENTRY_VALUE(entry);
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
-static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffman_tree* codetreeD, huffman_tree* codelengthcodetree, const unsigned char *in, unsigned long *bp, unsigned long inlength)
+static void get_tree_inflate_dynamic(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD, bit_reader* br)
 {
+	uint32_t codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
+	huffman_table codelengthcodetree;
 	unsigned codelengthcode[NUM_CODE_LENGTH_CODES];
 	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
 	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
 	unsigned n, hlit, hdist, hclen, i;
 
-	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
-	/*C-code note: use no "return" between ctor and dtor of an uivector! */
-	if ((*bp) >> 3 >= inlength - 2) {
-		SET_ERROR(upng, UPNG_EMALFORMED);
-		return;
-	}
+	huffman_table_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES);
 
-	/* clear bitlen arrays */
+	/*make sure that length values that aren't filled in will be 0, or a wrong tree will be generated */
 	memset(bitlen, 0, sizeof(bitlen));
 	memset(bitlenD, 0, sizeof(bitlenD));
 
-	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(br, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(br, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(br, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
 		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+			codelengthcode[CLCL[i]] = read_bits(br, 3);
 		} else {
 			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
 		}
 	}
 
-	huffman_tree_create_lengths(upng, codelengthcodetree, codelengthcode);
+	/*the bit pointer is or will go past the memory */
+	if (bit_reader_overrun(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
+	}
+
+	huffman_table_create_lengths(upng, &codelengthcodetree, codelengthcode);
 
 	/* bail now if we encountered an error earlier */
 	if (upng->error != UPNG_EOK) {
@@ -336,7 +387,8 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*now we can use this tree to read the lengths for the tree that this function will return */
 	i = 0;
 	while (i < hlit + hdist) {	/*i is the current symbol we're reading in the part that contains the code lengths of lit/len codes and dist codes */
-		unsigned code = huffman_decode_symbol(upng, in, bp, codelengthcodetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, br, &codelengthcodetree);
+		unsigned replength, value;
 		if (upng->error != UPNG_EOK) {
 			break;
 		}
@@ -348,90 +400,52 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 				bitlenD[i - hlit] = code;
 			}
 			i++;
+			continue;
 		} else if (code == 16) {	/*repeat previous */
-			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
-			unsigned value;	/*set value to the previous code */
-
-			if ((*bp) >> 3 >= inlength) {
+			/* error: there is no previous value */
+			if (i == 0) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
 
+			replength = 3 + read_bits(br, 2);	/*read in the 2 bits that indicate repeat length (3-6) */
 			if ((i - 1) < hlit) {
 				value = bitlen[i - 1];
 			} else {
 				value = bitlenD[i - hlit - 1];
 			}
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-
-				if (i < hlit) {
-					bitlen[i] = value;
-				} else {
-					bitlenD[i - hlit] = value;
-				}
-				i++;
-			}
 		} else if (code == 17) {	/*repeat "0" 3-10 times */
-			unsigned replength = 3;	/*read in the bits that indicate repeat length */
-			if ((*bp) >> 3 >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				break;
-			}
-
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
+			replength = 3 + read_bits(br, 3);
+			value = 0;
+		} else if (code == 18) {	/*repeat "0" 11-138 times */
+			replength = 11 + read_bits(br, 7);
+			value = 0;
+		} else {
+			/* somehow an unexisting code appeared. This can never happen. */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			break;
+		}
 
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* error: i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
+		/* error, bit pointer jumps past memory */
+		if (bit_reader_overrun(br)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			break;
+		}
 
-				if (i < hlit) {
-					bitlen[i] = 0;
-				} else {
-					bitlenD[i - hlit] = 0;
-				}
-				i++;
-			}
-		} else if (code == 18) {	/*repeat "0" 11-138 times */
-			unsigned replength = 11;	/*read in the bits that indicate repeat length */
-			/* error, bit pointer jumps past memory */
-			if ((*bp) >> 3 >= inlength) {
+		/*repeat this value in the next lengths */
+		for (n = 0; n < replength; n++) {
+			/* i is larger than the amount of codes */
+			if (i >= hlit + hdist) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
 
-			replength += read_bits(bp, in, 7);
-
-			/*repeat this value in the next lengths */
-			for (n = 0; n < replength; n++) {
-				/* i is larger than the amount of codes */
-				if (i >= hlit + hdist) {
-					SET_ERROR(upng, UPNG_EMALFORMED);
-					break;
-				}
-				if (i < hlit)
-					bitlen[i] = 0;
-				else
-					bitlenD[i - hlit] = 0;
-				i++;
+			if (i < hlit) {
+				bitlen[i] = value;
+			} else {
+				bitlenD[i - hlit] = value;
 			}
-		} else {
-			/* somehow an unexisting code appeared. This can never happen. */
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			break;
+			i++;
 		}
 	}
 
@@ -442,40 +456,64 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	/*the length of the end code 256 must be larger than 0 */
 	/*now we've finally got hlit and hdist, so generate the code trees, and the function is done */
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetree, bitlen);
+		huffman_table_create_lengths(upng, codetree, bitlen);
 	}
 	if (upng->error == UPNG_EOK) {
-		huffman_tree_create_lengths(upng, codetreeD, bitlenD);
+		huffman_table_create_lengths(upng, codetreeD, bitlenD);
+	}
+}
+
+/* get the fixed trees of a deflated block with btype 1 */
+static void get_tree_inflate_fixed(upng_t* upng, huffman_table* codetree, huffman_table* codetreeD)
+{
+	unsigned bitlen[NUM_DEFLATE_CODE_SYMBOLS];
+	unsigned bitlenD[NUM_DISTANCE_SYMBOLS];
+	unsigned n;
+
+	for (n = 0; n < NUM_DEFLATE_CODE_SYMBOLS; n++) {
+		if (n <= 143) {
+			bitlen[n] = 8;
+		} else if (n <= 255) {
+			bitlen[n] = 9;
+		} else if (n <= 279) {
+			bitlen[n] = 7;
+		} else {
+			bitlen[n] = 8;
+		}
+	}
+	for (n = 0; n < NUM_DISTANCE_SYMBOLS; n++) {
+		bitlenD[n] = 5;
 	}
+
+	huffman_table_create_lengths(upng, codetree, bitlen);
+	huffman_table_create_lengths(upng, codetreeD, bitlenD);
 }
 
 /*inflate a block with dynamic of fixed Huffman tree*/
-static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength, unsigned btype)
+static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos, unsigned btype)
 {
-	unsigned codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
-	unsigned codetreeD_buffer[DISTANCE_BUFFER_SIZE];
+	uint32_t codetree_buffer[DEFLATE_CODE_BUFFER_SIZE];
+	uint32_t codetreeD_buffer[DISTANCE_BUFFER_SIZE];
 	unsigned done = 0;
 
-	huffman_tree codetree;
-	huffman_tree codetreeD;
+	huffman_table codetree;
+	huffman_table codetreeD;
+
+	huffman_table_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS);
+	huffman_table_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS);
 
 	if (btype == 1) {
-		/* fixed trees */
-		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
+		get_tree_inflate_fixed(upng, &codetree, &codetreeD);
 	} else if (btype == 2) {
-		/* dynamic trees */
-		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
-		huffman_tree codelengthcodetree;
+		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, br);
+	}
 
-		huffman_tree_init(&codetree, codetree_buffer, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
-		huffman_tree_init(&codetreeD, codetreeD_buffer, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
-		huffman_tree_init(&codelengthcodetree, codelengthcodetree_buffer, NUM_CODE_LENGTH_CODES, CODE_LENGTH_BITLEN);
-		get_tree_inflate_dynamic(upng, &codetree, &codetreeD, &codelengthcodetree, in, bp, inlength);
+	if (upng->error != UPNG_EOK) {
+		return;
 	}
 
 	while (done == 0) {
-		unsigned code = huffman_decode_symbol(upng, in, bp, &codetree, inlength);
+		unsigned code = huffman_decode_symbol(upng, br, &codetree);
 		if (upng->error != UPNG_EOK) {
 			return;
 		}
@@ -493,23 +531,16 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 			/* store output */
 			out[(*pos)++] = (unsigned char)(code);
 		} else if (code >= FIRST_LENGTH_CODE_INDEX && code <= LAST_LENGTH_CODE_INDEX) {	/*length code */
-			/* part 1: get length base */
-			unsigned long length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX];
-			unsigned codeD, distance, numextrabitsD;
-			unsigned long start, forward, backward, numextrabits;
+			unsigned long length, distance, forward;
+			unsigned codeD;
+			const unsigned char *from;
+			unsigned char *to;
 
-			/* part 2: get extra bits and add the value of that to length */
-			numextrabits = LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX];
-
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
-				SET_ERROR(upng, UPNG_EMALFORMED);
-				return;
-			}
-			length += read_bits(bp, in, numextrabits);
+			/* part 1 and 2: get length base, then the extra bits and add the value of that to length */
+			length = LENGTH_BASE[code - FIRST_LENGTH_CODE_INDEX] + read_bits(br, LENGTH_EXTRA[code - FIRST_LENGTH_CODE_INDEX]);
 
 			/*part 3: get distance code */
-			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
+			codeD = huffman_decode_symbol(upng, br, &codetreeD);
 			if (upng->error != UPNG_EOK) {
 				return;
 			}
@@ -520,60 +551,69 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 				return;
 			}
 
-			distance = DISTANCE_BASE[codeD];
-
 			/*part 4: get extra bits from distance */
-			numextrabitsD = DISTANCE_EXTRA[codeD];
+			distance = DISTANCE_BASE[codeD] + read_bits(br, DISTANCE_EXTRA[codeD]);
 
-			/* error, bit pointer will jump past memory */
-			if (((*bp) >> 3) >= inlength) {
+			/* error, bit pointer jumped past memory */
+			if (bit_reader_overrun(br)) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
-			distance += read_bits(bp, in, numextrabitsD);
-
-			/*part 5: fill in all the out[n] values based on the length and dist */
-			start = (*pos);
-			backward = start - distance;
+			/* error, distance reaches back before the start of the output */
+			if (distance > (*pos)) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
 
 			if ((*pos) + length >= outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
 
+			/*part 5: fill in all the out[n] values based on the length and dist; copying forward one byte at a time
+			  repeats the last distance bytes when the match overlaps itself, as the spec requires */
+			from = &out[(*pos) - distance];
+			to = &out[*pos];
 			for (forward = 0; forward < length; forward++) {
-				out[(*pos)++] = out[backward];
-				backward++;
-
-				if (backward >= start) {
-					backward = start - distance;
-				}
+				to[forward] = from[forward];
 			}
+			(*pos) += length;
+		} else {
+			/* codes 286-287 are never used */
+			SET_ERROR(upng, UPNG_EMALFORMED);
+			return;
 		}
 	}
 }
 
-static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long *bp, unsigned long *pos, unsigned long inlength)
+static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long outsize, bit_reader* br, unsigned long *pos)
 {
 	unsigned long p;
-	unsigned len, nlen, n;
+	unsigned len, nlen;
 
 	/* go to first boundary of byte */
-	while (((*bp) & 0x7) != 0) {
-		(*bp)++;
+	read_bits(br, br->count & 0x7);
+	if (bit_reader_overrun(br)) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return;
 	}
-	p = (*bp) / 8;		/*byte position */
+
+	/*byte position: hand the bytes still sitting in the bit buffer back to the stream */
+	p = br->pos - (br->count - br->padding) / 8;
+	br->buffer = 0;
+	br->count = 0;
+	br->padding = 0;
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	if (p + 4 > br->size) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	len = in[p] + 256 * in[p + 1];
+	len = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
-	nlen = in[p] + 256 * in[p + 1];
+	nlen = br->in[p] + 256 * br->in[p + 1];
 	p += 2;
 
 	/* check if 16-bit nlen is really the one's complement of len */
@@ -588,47 +628,48 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 	}
 
 	/* read the literal data: len bytes are now stored in the out buffer */
-	if (p + len > inlength) {
+	if (p + len > br->size) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
 
-	for (n = 0; n < len; n++) {
-		out[(*pos)++] = in[p++];
-	}
+	memcpy(&out[*pos], &br->in[p], len);
+	(*pos) += len;
 
-	(*bp) = p * 8;
+	br->pos = p + len;
 }
 
 /*inflate the deflated data (cfr. deflate spec); return value is the error*/
 static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned long outsize, const unsigned char *in, unsigned long insize, unsigned long inpos)
 {
-	unsigned long bp = 0;	/*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte) */
+	bit_reader br;	/*reads the "in" data lsb first, starting past the zlib header */
 	unsigned long pos = 0;	/*byte position in the out buffer */
 
 	unsigned done = 0;
 
+	bit_reader_init(&br, &in[inpos], insize - inpos);
+
 	while (done == 0) {
 		unsigned btype;
 
-		/* ensure next bit doesn't point past the end of the buffer */
-		if ((bp >> 3) >= insize) {
+		/* read block control bits */
+		done = read_bits(&br, 1);
+		btype = read_bits(&br, 2);
+
+		/* ensure the block header didn't point past the end of the buffer */
+		if (bit_reader_overrun(&br)) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		}
 
-		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
-
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, outsize, &br, &pos);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, outsize, &br, &pos, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -688,7 +729,8 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
-static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+/* reference implementation of the filters, which the SIMD versions are checked against */
+static void unfilter_scanline_scalar(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
 	/*
 	   For PNG filter method 0
@@ -750,6 +792,135 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	}
 }
 
+#if defined(UPNG_SSE2)
+/* SSE2 versions of the filters, used when a scanline has 3 or 4 bytes per pixel (RGB8 and RGBA8). Sub, Average and Paeth
+ * depend on the pixel to the left, so they're computed a pixel at a time with all of its bytes in one register; Up has no
+ * such dependency and is done 16 bytes at a time for any pixel size. They must match unfilter_scanline_scalar bit for bit. */
+
+/* pixels are moved with fixed size copies so they compile to plain loads and stores; a 3 byte pixel must not touch the
+ * byte after it, which may be past the end of the buffer or belong to the next pixel */
+static __m128i load_pixel(const unsigned char *p, unsigned long bytewidth)
+{
+	uint32_t v = 0;
+	if (bytewidth == 4) {
+		memcpy(&v, p, 4);
+	} else {
+		memcpy(&v, p, 3);
+	}
+	return _mm_cvtsi32_si128((int)v);
+}
+
+static void store_pixel(unsigned char *p, __m128i v, unsigned long bytewidth)
+{
+	uint32_t x = (uint32_t)_mm_cvtsi128_si32(v);
+	if (bytewidth == 4) {
+		memcpy(p, &x, 4);
+	} else {
+		memcpy(p, &x, 3);
+	}
+}
+
+static __m128i abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i if_then_else(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void unfilter_sub_sse2(unsigned char *recon, const unsigned char *scanline, unsigned long bytewidth, unsigned long length)
+{
+	__m128i a = _mm_setzero_si128();	/*the reconstructed pixel to the left */
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		a = _mm_add_epi8(load_pixel(&scanline[i], bytewidth), a);
+		store_pixel(&recon[i], a, bytewidth);
+	}
+}
+
+static void unfilter_up_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long length)
+{
+	unsigned long i;
+	for (i = 0; i + 16 <= length; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+		__m128i b = _mm_loadu_si128((const __m128i*)&precon[i]);
+		_mm_storeu_si128((__m128i*)&recon[i], _mm_add_epi8(x, b));
+	}
+	for (; i < length; i++) {
+		recon[i] = scanline[i] + precon[i];
+	}
+}
+
+static void unfilter_average_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	const __m128i ones = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = load_pixel(&precon[i], bytewidth);
+		/* _mm_avg_epu8 rounds up, so take the carry back off when a + b is odd */
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+		a = _mm_add_epi8(load_pixel(&scanline[i], bytewidth), average);
+		store_pixel(&recon[i], a, bytewidth);
+	}
+}
+
+static void unfilter_paeth_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned long length)
+{
+	/* the predictor needs signed intermediates, so the neighbours are widened to 16 bits */
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low_bytes = _mm_set1_epi16(0xFF);
+	__m128i a = zero, c = zero;	/*left and upper-left neighbours */
+	unsigned long i;
+	for (i = 0; i < length; i += bytewidth) {
+		__m128i b = _mm_unpacklo_epi8(load_pixel(&precon[i], bytewidth), zero);
+		__m128i x = _mm_unpacklo_epi8(load_pixel(&scanline[i], bytewidth), zero);
+
+		/* with p = a + b - c: pa = |p - a|, pb = |p - b|, pc = |p - c| */
+		__m128i pa = abs_epi16(_mm_sub_epi16(b, c));
+		__m128i pb = abs_epi16(_mm_sub_epi16(a, c));
+		__m128i pc = abs_epi16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+
+		/* ties favour a over b over c, like paeth_predictor */
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		__m128i predictor = if_then_else(_mm_cmpeq_epi16(smallest, pa), a, if_then_else(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		a = _mm_and_si128(_mm_add_epi16(x, predictor), low_bytes);
+		store_pixel(&recon[i], _mm_packus_epi16(a, a), bytewidth);
+		c = b;
+	}
+}
+#endif
+
+static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
+{
+#if defined(UPNG_SSE2)
+	/* the first scanline has no previous one to predict from, which is left to the scalar code (except for Sub) */
+	if (upng->use_simd) {
+		if (filterType == 2 && precon) {
+			unfilter_up_sse2(recon, scanline, precon, length);
+			return;
+		}
+		if (bytewidth == 3 || bytewidth == 4) {
+			if (filterType == 1) {
+				unfilter_sub_sse2(recon, scanline, bytewidth, length);
+				return;
+			} else if (filterType == 3 && precon) {
+				unfilter_average_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			} else if (filterType == 4 && precon) {
+				unfilter_paeth_sse2(recon, scanline, precon, bytewidth, length);
+				return;
+			}
+		}
+	}
+#endif
+
+	unfilter_scanline_scalar(upng, recon, scanline, precon, bytewidth, filterType, length);
+}
+
 static void unfilter(upng_t* upng, unsigned char *out, const unsigned char *in, unsigned w, unsigned h, unsigned bpp)
 {
 	/*
@@ -854,6 +1025,19 @@ static upng_format determine_format(upng_t* upng) {
 		default:
 			return UPNG_BADFORMAT;
 		}
+	case UPNG_PLT:
+		switch (upng->color_depth) {
+		case 1:
+			return UPNG_PALETTE1;
+		case 2:
+			return UPNG_PALETTE2;
+		case 4:
+			return UPNG_PALETTE4;
+		case 8:
+			return UPNG_PALETTE8;
+		default:
+			return UPNG_BADFORMAT;
+		}
 	case UPNG_LUMA:
 		switch (upng->color_depth) {
 		case 1:
@@ -1027,6 +1211,30 @@ upng_error upng_decode(upng_t* upng)
 		/* parse chunks */
 		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
 			compressed_size += length;
+		} else if (upng_chunk_type(chunk) == CHUNK_PLTE) {
+			/* only paletted images need it; for others it's a suggestion we can ignore */
+			if (length % 3 != 0 || length == 0 || length > 256 * 3) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return upng->error;
+			}
+			upng->palette_size = length / 3;
+			for (unsigned i = 0; i < upng->palette_size; i += 1) {
+				upng->palette[i * 4 + 0] = data[i * 3 + 0];
+				upng->palette[i * 4 + 1] = data[i * 3 + 1];
+				upng->palette[i * 4 + 2] = data[i * 3 + 2];
+				upng->palette[i * 4 + 3] = 255;
+			}
+		} else if (upng_chunk_type(chunk) == CHUNK_tRNS) {
+			/* alpha for the first palette entries; color keys for other types are not supported */
+			if (upng->color_type == UPNG_PLT) {
+				if (length > upng->palette_size) {
+					SET_ERROR(upng, UPNG_EMALFORMED);
+					return upng->error;
+				}
+				for (unsigned i = 0; i < length; i += 1) {
+					upng->palette[i * 4 + 3] = data[i];
+				}
+			}
 		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
 			break;
 		} else if (upng_chunk_critical(chunk)) {
@@ -1037,6 +1245,12 @@ upng_error upng_decode(upng_t* upng)
 		chunk += upng_chunk_length(chunk) + 12;
 	}
 
+	/* a paletted image can't be decoded without its palette */
+	if (upng->color_type == UPNG_PLT && upng->palette_size == 0) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return upng->error;
+	}
+
 	/* allocate enough space for the (compressed and filtered) image data */
 	compressed = (unsigned char*)malloc(compressed_size);
 	if (compressed == NULL) {
@@ -1075,7 +1289,9 @@ upng_error upng_decode(upng_t* upng)
 	}
 
 	/* decompress image data */
+	TRACE_PHASE_BEGIN(upng, "png_inflate");
 	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
+	TRACE_PHASE_END(upng, "png_inflate");
 	if (error != UPNG_EOK) {
 		free(compressed);
 		free(inflated);
@@ -1096,7 +1312,9 @@ upng_error upng_decode(upng_t* upng)
 	}
 
 	/* unfilter scanlines */
+	TRACE_PHASE_BEGIN(upng, "png_unfilter");
 	post_process_scanlines(upng, upng->buffer, inflated, upng);
+	TRACE_PHASE_END(upng, "png_unfilter");
 	free(inflated);
 
 	if (upng->error != UPNG_EOK) {
@@ -1125,6 +1343,8 @@ static upng_t* upng_new(void)
 	upng->buffer = NULL;
 	upng->size = 0;
 
+	upng->palette_size = 0;
+
 	upng->width = upng->height = 0;
 
 	upng->color_type = UPNG_RGBA;
@@ -1140,6 +1360,11 @@ static upng_t* upng_new(void)
 	upng->source.size = 0;
 	upng->source.owning = 0;
 
+	upng->trace_begin = NULL;
+	upng->trace_end = NULL;
+
+	upng->use_simd = 1;
+
 	return upng;
 }
 
@@ -1212,6 +1437,17 @@ void upng_free(upng_t* upng)
 	free(upng);
 }
 
+void upng_set_trace(upng_t* upng, upng_trace_fn begin, upng_trace_fn end)
+{
+	upng->trace_begin = begin;
+	upng->trace_end = end;
+}
+
+void upng_set_simd(upng_t* upng, int enabled)
+{
+	upng->use_simd = enabled;
+}
+
 upng_error upng_get_error(const upng_t* upng)
 {
 	return upng->error;
@@ -1244,6 +1480,8 @@ unsigned upng_get_components(const upng_t* upng)
 		return 1;
 	case UPNG_RGB:
 		return 3;
+	case UPNG_PLT:
+		return 1;
 	case UPNG_LUMA:
 		return 2;
 	case UPNG_RGBA:
@@ -1279,3 +1517,9 @@ unsigned upng_get_size(const upng_t* upng)
 {
 	return upng->size;
 }
+
+const unsigned char* upng_get_palette(const upng_t* upng, unsigned* size)
+{
+	*size = upng->palette_size;
+	return upng->palette;
+}
@@ -52,11 +52,19 @@ typedef enum upng_format {
 	UPNG_LUMINANCE_ALPHA1,
 	UPNG_LUMINANCE_ALPHA2,
 	UPNG_LUMINANCE_ALPHA4,
-	UPNG_LUMINANCE_ALPHA8
+	UPNG_LUMINANCE_ALPHA8,
+	UPNG_PALETTE1,
+	UPNG_PALETTE2,
+	UPNG_PALETTE4,
+	UPNG_PALETTE8
 } upng_format;
 
 typedef struct upng_t upng_t;
 
+/* called with the name of a decoding phase ("png_inflate", "png_unfilter")
+ * as it begins and ends; the name is a string literal */
+typedef void (*upng_trace_fn)(const char* name);
+
 upng_t*		upng_new_from_bytes	(const unsigned char* buffer, unsigned long size);
 upng_t*		upng_new_from_file	(const char* path);
 void		upng_free			(upng_t* upng);
@@ -64,6 +72,14 @@ void		upng_free			(upng_t* upng);
 upng_error	upng_header			(upng_t* upng);
 upng_error	upng_decode			(upng_t* upng);
 
+/* optional hooks around the phases of decoding, e.g. for a profiler; NULL
+ * (the default) for none */
+void		upng_set_trace		(upng_t* upng, upng_trace_fn begin, upng_trace_fn end);
+
+/* SIMD code paths are used by default where available; disabling them for
+ * a decoder selects the scalar reference code, e.g. to check the two match */
+void		upng_set_simd		(upng_t* upng, int enabled);
+
 upng_error	upng_get_error		(const upng_t* upng);
 unsigned	upng_get_error_line	(const upng_t* upng);
 
@@ -78,4 +94,8 @@ upng_format	upng_get_format		(const upng_t* upng);
 const unsigned char*	upng_get_buffer		(const upng_t* upng);
 unsigned				upng_get_size		(const upng_t* upng);
 
+/* RGBA entries of the palette of a paletted image, whose buffer holds palette
+ * indices; size is set to the number of entries */
+const unsigned char*	upng_get_palette	(const upng_t* upng, unsigned* size);
+
 #endif /*defined(UPNG_H)*/
@@ -96,6 +96,15 @@ vec3_t vec3_div(vec3_t v, float factor) {
     };
 }
 
+// From a (t = 0) to b (t = 1)
+vec3_t vec3_lerp(vec3_t a, vec3_t b, float t) {
+    return (vec3_t) {
+        .x = a.x + (b.x - a.x) * t,
+        .y = a.y + (b.y - a.y) * t,
+        .z = a.z + (b.z - a.z) * t,
+    };
+}
+
 vec3_t vec3_cross(vec3_t a, vec3_t b) {
     return (vec3_t) {
         .x = a.y * b.z - a.z * b.y,
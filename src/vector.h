@@ -31,6 +31,7 @@ vec3_t vec3_sub(vec3_t a, vec3_t b);
 vec3_t vec3_mul(vec3_t v, float factor);
 vec3_t vec3_div(vec3_t v, float factor);
 vec3_t vec3_cross(vec3_t a, vec3_t b);
+vec3_t vec3_lerp(vec3_t a, vec3_t b, float t);
 float vec3_dot(vec3_t a, vec3_t b);
 void vec3_normalize(vec3_t *v);
 